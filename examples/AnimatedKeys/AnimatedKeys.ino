@@ -0,0 +1,102 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+
+/* Animated GIF keys example
+
+   Requires an SD card in the Teensy 4.1 builtin slot holding animated GIFs
+   named /key0.gif, /key1.gif, ... up to /key3.gif.
+
+   On connect, plays each GIF it finds on the matching key, all at once and
+   each at its own speed. Pressing a key pauses or resumes its animation.
+   Nothing is pre-rendered: frames are decoded from the card as they are
+   shown.
+*/
+#include <SD.h>
+#include "streamdeck.h"
+
+#define ANIMATED_KEYS 4
+
+USBHost myusb;
+USBHIDParser hid1(myusb);
+Streamdeck::StreamdeckController sdc1(myusb);
+
+Streamdeck::AnimationScheduler scheduler(&sdc1);
+Streamdeck::KeyAnimation *animations[ANIMATED_KEYS] = {};
+bool connected = false;
+
+void keyPressed(Streamdeck::StreamdeckController *sdc, uint16_t keyIndex,
+                uint8_t newValue, uint8_t oldValue) {
+  if (newValue != 1 || keyIndex >= ANIMATED_KEYS || !animations[keyIndex])
+    return;
+  if (scheduler.isPlaying(keyIndex))
+    scheduler.stop(keyIndex);
+  else
+    scheduler.play(animations[keyIndex], keyIndex);
+}
+
+void startAnimations() {
+  for (uint8_t i = 0; i < ANIMATED_KEYS; i++) {
+    char path[16];
+    snprintf(path, sizeof(path), "/key%u.gif", i);
+    animations[i] = new Streamdeck::KeyAnimation(sdc1.getSettings());
+    if (animations[i]->open(path)) {
+      scheduler.play(animations[i], i);
+    } else {
+      delete animations[i];
+      animations[i] = nullptr;
+    }
+  }
+}
+
+void stopAnimations() {
+  scheduler.stopAll();
+  for (uint8_t i = 0; i < ANIMATED_KEYS; i++) {
+    delete animations[i];
+    animations[i] = nullptr;
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  if (!SD.begin(BUILTIN_SDCARD))
+    Serial.println("No SD card found.");
+  myusb.begin();
+}
+
+void loop() {
+  myusb.Task();
+
+  if (sdc1 != connected) {
+    connected = sdc1;
+    if (connected) {
+      sdc1.attachSinglePress(keyPressed);
+      startAnimations();
+    } else {
+      stopAnimations();
+    }
+  }
+
+  if (connected) {
+    sdc1.Task();
+    scheduler.Task();
+  }
+}
@@ -111,7 +111,6 @@ void loop() {
     if (hid_driver_active[i]) {
       StreamdeckController *sdc = (StreamdeckController *)hiddrivers[i];
       sdc->Task();
-      delay(1);
     }
   }
 }
@@ -123,5 +122,4 @@ void buttonPressed(Streamdeck::StreamdeckController *sdc, uint16_t keyIndex,
   } else {
     sdc->setKeyImage(keyIndex, image_released, sizeof(image_released));
   }
-  delay(1);
 }
\ No newline at end of file
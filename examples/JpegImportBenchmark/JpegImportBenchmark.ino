@@ -0,0 +1,138 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+/* JPEG import benchmark
+
+   Requires an SD card in the Teensy 4.1 builtin slot holding a large JPEG
+   (a camera photo works well) at /bench.jpg. No deck is needed.
+
+   Imports the photo into a 72x72 and a 96x96 key image twice: once the old
+   way, decoding at full size into a temporary framebuffer and scaling that
+   down with tgx, and once through Image::importJpeg, which lets JPEGDEC
+   shrink the image by up to 8 while decoding and scales each decoded block
+   straight into the key. Prints the time each took and the size of the
+   temporary framebuffer each needed.
+*/
+#include <SD.h>
+#include <JPEGDEC.h>
+#include "streamdeck.h"
+
+#define BENCH_FILE "/bench.jpg"
+#define RUNS 5
+
+JPEGDEC decoder;
+
+static int drawToImage(JPEGDRAW *pDraw) {
+  tgx::Image<tgx::RGB565> *dst = (tgx::Image<tgx::RGB565> *)pDraw->pUser;
+  const tgx::Image<tgx::RGB565> block((tgx::RGB565 *)pDraw->pPixels,
+                                      pDraw->iWidthUsed, pDraw->iHeight,
+                                      pDraw->iWidth);
+  dst->blit(block, tgx::iVec2(pDraw->x, pDraw->y));
+  return 1;
+}
+
+// Full-size decode followed by a tgx downscale, as importJpeg used to work.
+bool importFullSize(Streamdeck::Image &im, uint32_t &tempBytes) {
+  File file = SD.open(BENCH_FILE);
+  if (!decoder.open(file, drawToImage))
+    return false;
+
+  const int width = decoder.getWidth(), height = decoder.getHeight();
+  tempBytes = (uint32_t)width * height * sizeof(tgx::RGB565);
+  tgx::RGB565 *tempFb = (tgx::RGB565 *)malloc(tempBytes);
+  if (!tempFb) {
+    decoder.close();
+    file.close();
+    return false;
+  }
+  tgx::Image<tgx::RGB565> tempImg(tempFb, width, height);
+  decoder.setUserPointer(&tempImg);
+  decoder.decode(0, 0, 0);
+  decoder.close();
+  file.close();
+
+  const float scale = width > height
+                          ? (float)im.IM()->width() / width
+                          : (float)im.IM()->height() / height;
+  im.IM()->blitScaledRotated(tempImg, tgx::fVec2(width / 2, height / 2),
+                             tgx::fVec2(im.IM()->width() / 2,
+                                        im.IM()->height() / 2),
+                             scale, 0.0f);
+  free(tempFb);
+  return true;
+}
+
+void benchmark(const int keySize) {
+  Streamdeck::Image im(keySize, keySize);
+
+  uint32_t fullBytes = 0;
+  uint32_t start = micros();
+  for (int i = 0; i < RUNS; i++) {
+    if (!importFullSize(im, fullBytes)) {
+      Serial.println("Full-size import failed (out of RAM?).");
+      fullBytes = 0;
+      break;
+    }
+  }
+  const uint32_t fullMicros = (micros() - start) / RUNS;
+
+  start = micros();
+  for (int i = 0; i < RUNS; i++) {
+    if (!im.importJpeg(BENCH_FILE)) {
+      Serial.println("Scaled import failed.");
+      return;
+    }
+  }
+  const uint32_t scaledMicros = (micros() - start) / RUNS;
+
+  // Work out the decode scale importJpeg picked; it needs no temporary
+  // framebuffer at all.
+  File file = SD.open(BENCH_FILE);
+  decoder.open(file, drawToImage);
+  const int width = decoder.getWidth(), height = decoder.getHeight();
+  decoder.close();
+  file.close();
+  const uint8_t shift =
+      Streamdeck::jpegScaleShift(width, height, keySize, keySize);
+
+  Serial.printf("%dx%d source onto a %dx%d key:\n", width, height, keySize,
+                keySize);
+  Serial.printf("  full size:  %8lu us, %8lu bytes temporary\n", fullMicros,
+                fullBytes);
+  Serial.printf("  1/%d decode: %8lu us, %8lu bytes temporary\n", 1 << shift,
+                scaledMicros, 0UL);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial && millis() < 3000) {
+  }
+
+  if (!SD.begin(BUILTIN_SDCARD) || !SD.exists(BENCH_FILE)) {
+    Serial.println("Put a large JPEG at " BENCH_FILE " on the SD card.");
+    return;
+  }
+
+  benchmark(72);
+  benchmark(96);
+}
+
+void loop() {}
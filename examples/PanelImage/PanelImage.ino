@@ -0,0 +1,88 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+
+/* Panel image example
+
+   Requires an SD card in the Teensy 4.1 builtin slot holding a JPEG at
+   /panel.jpg, as large as you like.
+
+   On connect, shows the picture across all of the deck's keys, with the
+   bezels between keys treated as part of the picture so it lines up like a
+   window. Only one row of keys is held in RAM while it is cut up, so this
+   works on the XL too. Pressing a key toggles the bezel compensation.
+*/
+#include <SD.h>
+#include "streamdeck.h"
+
+#define PANEL_FILE "/panel.jpg"
+// Bezel between keys as a fraction of a key's width, about right for the
+// 15-key decks.
+#define BEZEL_PERCENT 25
+
+USBHost myusb;
+USBHIDParser hid1(myusb);
+Streamdeck::StreamdeckController sdc1(myusb);
+
+Streamdeck::PanelImporter panel(&sdc1);
+bool connected = false;
+bool bezels = true;
+
+void showPanel() {
+  const uint16_t gap =
+      bezels ? sdc1.getSettings()->keyWidth * BEZEL_PERCENT / 100 : 0;
+  panel.setBezelGap(gap);
+  const uint32_t start = millis();
+  if (panel.importJpeg(PANEL_FILE))
+    Serial.printf("Panel sent in %lu ms\n", millis() - start);
+  else
+    Serial.println("Couldn't import " PANEL_FILE);
+}
+
+void keyPressed(Streamdeck::StreamdeckController *sdc, uint16_t keyIndex,
+                uint8_t newValue, uint8_t oldValue) {
+  if (newValue != 1)
+    return;
+  bezels = !bezels;
+  showPanel();
+}
+
+void setup() {
+  Serial.begin(115200);
+  if (!SD.begin(BUILTIN_SDCARD))
+    Serial.println("No SD card found.");
+  myusb.begin();
+}
+
+void loop() {
+  myusb.Task();
+
+  if (sdc1 != connected) {
+    connected = sdc1;
+    if (connected) {
+      sdc1.attachSinglePress(keyPressed);
+      showPanel();
+    }
+  }
+
+  if (connected)
+    sdc1.Task();
+}
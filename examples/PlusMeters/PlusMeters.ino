@@ -0,0 +1,109 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Stream Deck+ dial meters
+
+   Each of the four dials drives a meter on the touchscreen segment above it.
+   Turning a dial moves its meter, pressing it resets the meter and tapping
+   the touchscreen zeroes the meter under your finger. Only the part of the
+   screen that changed is re-encoded and uploaded.
+*/
+#include <USBHost_t36.h>
+#include "streamdeck.h"
+
+using namespace Streamdeck;
+
+USBHost myusb;
+USBHIDParser hid1(myusb);
+StreamdeckController sdc1(myusb);
+
+bool connected = false;
+ScreenCanvas *screen = nullptr;
+int16_t levels[MAX_DIALS] = {50, 50, 50, 50};
+
+void drawMeter(uint8_t dial) {
+  const int segment = sdc1.getSettings()->screenWidth / MAX_DIALS;
+  const int height = sdc1.getSettings()->screenHeight;
+  const int left = dial * segment + 20;
+  const int right = (dial + 1) * segment - 21;
+  const int fill = left + (right - left) * levels[dial] / 100;
+
+  tgx::iBox2 meter(left, right, height / 2 - 10, height / 2 + 10);
+  screen->IM()->fillRect(meter, tgx::RGB565_Black);
+  if (fill > left)
+    screen->IM()->fillRect(
+        tgx::iBox2(left, fill, meter.minY, meter.maxY), tgx::RGB565_Green);
+  screen->markDirty(meter);
+}
+
+void onControl(StreamdeckController *sdc, const control_event_t *event,
+               void *context) {
+  if (!screen)
+    return;
+
+  uint8_t dial = event->dialIndex;
+  switch (event->type) {
+  case CONTROL_EVENT_DIAL_TURN:
+    // One event per Task() however fast the dial spins.
+    levels[dial] = constrain(levels[dial] + event->delta, 0, 100);
+    break;
+  case CONTROL_EVENT_DIAL_PRESS:
+    if (!event->pressed)
+      return;
+    levels[dial] = 50;
+    break;
+  case CONTROL_EVENT_TOUCH_TAP:
+    dial = min(event->x / (sdc->getSettings()->screenWidth / MAX_DIALS),
+               MAX_DIALS - 1);
+    levels[dial] = 0;
+    break;
+  default:
+    return;
+  }
+  drawMeter(dial);
+}
+
+void setup() {
+  myusb.begin();
+  sdc1.subscribe(onControl);
+}
+
+void loop() {
+  myusb.Task();
+
+  if (sdc1 != connected) {
+    connected = sdc1;
+    delete screen;
+    screen = nullptr;
+    if (connected && sdc1.getSettings()->dialCount) {
+      screen = new ScreenCanvas(sdc1.getSettings());
+      screen->IM()->fillScreen(tgx::RGB565_Black);
+      screen->markAllDirty();
+      for (uint8_t i = 0; i < MAX_DIALS; i++)
+        drawMeter(i);
+    }
+  }
+
+  // Upload changes once the previous uploads have been handed to the driver.
+  if (sdc1.Task(500) == 0 && screen && screen->isDirty())
+    screen->sendDirty(&sdc1);
+}
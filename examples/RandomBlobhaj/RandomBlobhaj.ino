@@ -108,7 +108,10 @@ void loop() {
     }
     if (hid_driver_active[i]) {
       StreamdeckController *sdc = (StreamdeckController *)hiddrivers[i];
-      sdc->Task();
+      // Give the controller up to 500us, and only render another image once
+      // the previous one has been handed to the USB driver.
+      if (sdc->Task(500) > 0)
+        continue;
 
       Streamdeck::Image im(sdc->getSettings());
       if (im.importJpegRandom((uint8_t **)blobhaj, blobhaj_sizes,
@@ -118,7 +121,6 @@ void loop() {
       } else {
         Serial.println("Failed to import Jpg.");
       }
-      delay(1);
     }
   }
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Input recording and replay example
+
+   Requires STREAMDECK_USBHOST_ENABLE_RECORDER set to 1 (in
+   streamdeck_config.hpp or as a build flag) and an SD card in the Teensy 4.1
+   builtin slot.
+
+   If /session.sdr does not exist, connect a Stream Deck: every input report
+   for the next 60 seconds is logged to it. Once it exists, no deck is needed;
+   the session is replayed through the same parsing path as fast as possible
+   and the time spent in Task() (event dispatch plus your handlers) is
+   printed.
+*/
+#include <SD.h>
+#include "streamdeck.h"
+
+#if !STREAMDECK_USBHOST_ENABLE_RECORDER
+#error "Set STREAMDECK_USBHOST_ENABLE_RECORDER to 1 for this example."
+#endif
+
+#define SESSION_FILE "/session.sdr"
+#define RECORD_MILLIS 60000
+
+USBHost myusb;
+USBHIDParser hid1(myusb);
+Streamdeck::StreamdeckController sdc1(myusb);
+
+USBHIDInput *hiddrivers[] = {&sdc1};
+#define CNT_HIDDEVICES (sizeof(hiddrivers) / sizeof(hiddrivers[0]))
+bool hid_driver_active[CNT_HIDDEVICES] = {false};
+
+Streamdeck::InputRecorder recorder;
+File session;
+uint32_t recordStart = 0;
+uint32_t pressCount = 0;
+
+// Stands in for whatever work your real handlers do.
+void countPress(Streamdeck::StreamdeckController *sdc,
+                const Streamdeck::key_event_t *event, void *context) {
+  (*(uint32_t *)context)++;
+}
+
+void replaySession() {
+  using namespace Streamdeck;
+  InputReplayer replayer;
+  if (!replayer.begin(session, &sdc1)) {
+    Serial.println("Not a valid recording.");
+    return;
+  }
+  sdc1.subscribe(KEY_EVENT_PRESS_RELEASE, countPress, &pressCount);
+
+  uint32_t taskMicros = 0;
+  bool more = true;
+  while (more) {
+    more = replayer.step();
+    const uint32_t start = micros();
+    while (sdc1.Task() > 0) {
+    }
+    taskMicros += micros() - start;
+  }
+  Serial.printf("Replayed %lu reports, %lu press/release events, %lu us in "
+                "Task()\n",
+                replayer.getReplayedReports(), pressCount, taskMicros);
+  session.close();
+}
+
+void setup() {
+  SD.begin(BUILTIN_SDCARD);
+  if (SD.exists(SESSION_FILE)) {
+    session = SD.open(SESSION_FILE);
+    replaySession();
+  }
+  myusb.begin();
+}
+
+void loop() {
+  using namespace Streamdeck;
+  myusb.Task();
+
+  for (uint8_t i = 0; i < CNT_HIDDEVICES; i++) {
+    if (*hiddrivers[i] != hid_driver_active[i]) {
+      hid_driver_active[i] = !hid_driver_active[i];
+      StreamdeckController *sdc = (StreamdeckController *)hiddrivers[i];
+      if (hid_driver_active[i] && !SD.exists(SESSION_FILE)) {
+        session = SD.open(SESSION_FILE, FILE_WRITE);
+        recorder.begin(session, sdc->getSettings()->productId);
+        sdc->attachRecorder(&recorder);
+        recordStart = millis();
+        Serial.println("Recording...");
+      }
+    }
+    if (hid_driver_active[i]) {
+      StreamdeckController *sdc = (StreamdeckController *)hiddrivers[i];
+      sdc->Task();
+
+      if (recordStart && millis() - recordStart > RECORD_MILLIS) {
+        sdc->attachRecorder(nullptr);
+        recorder.end();
+        session.close();
+        recordStart = 0;
+        Serial.printf("Recorded %lu reports (%lu dropped).\n",
+                      recorder.getRecordedReports(),
+                      recorder.getDroppedReports());
+      }
+    }
+  }
+}
@@ -144,7 +144,8 @@ void loop() {
     if (hid_driver_active[i]) {
       StreamdeckController *sdc = (StreamdeckController *)hiddrivers[i];
       device_settings_t *settings = sdc->getSettings();
-      sdc->Task();
+      // Bounded so the audio side is never starved.
+      sdc->Task(500);
       getLevels(audioLevels);
 
       const uint8_t kRows = settings->keyRows;
@@ -189,17 +190,23 @@ void loop() {
 
             float splitPeak = audioPeak / (float)kRows;
 
+            // Images are drawn upright; sendToKey applies the deck's
+            // rotation. Bars grow up from the bottom of the key.
             uint16_t barLeft = c * colWidth;
             uint16_t barRight = (c * colWidth) + colWidth - 2;
-            uint16_t barTop = 0;
-            uint16_t barBottom = kHeight * (audioPeak - rowSplit) * kRows;
+            uint16_t barBottom = kHeight - 1;
+            uint16_t barTop =
+                kHeight - kHeight * constrain((audioPeak - rowSplit) * kRows,
+                                              0.0f, 1.0f);
             tgx::iBox2 bar(barLeft, barRight, barTop, barBottom);
 
-            if (barBottom != barTop)
+            if (barTop <= barBottom)
               im.IM()->fillRect(bar, colour);
 
-            uint16_t barPeak = kHeight * (peakLine - rowSplit) * kRows;
-            if (barPeak != barTop)
+            uint16_t barPeak =
+                kHeight - kHeight * constrain((peakLine - rowSplit) * kRows,
+                                              0.0f, 1.0f);
+            if (barPeak <= barBottom)
               im.IM()->drawThickLineAA(tgx::fVec2(barLeft, barPeak),
                                        tgx::fVec2(barRight, barPeak), 2.0,
                                        tgx::END_ROUNDED, tgx::END_ROUNDED,
@@ -219,7 +226,6 @@ void loop() {
                jpegCount / settings->keyCount);
         jpegCount = 0;
       }
-      delay(1);
     }
   }
 }
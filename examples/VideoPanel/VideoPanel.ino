@@ -0,0 +1,92 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+
+/* Full-panel video example
+
+   Requires an SD card in the Teensy 4.1 builtin slot holding an MJPEG file
+   at /video.mjpeg. Make one from any video with ffmpeg, scaled to roughly
+   the size of the key grid:
+
+     ffmpeg -i in.mp4 -vf scale=480:-2 -r 15 -q:v 6 video.mjpeg
+
+   On connect, plays the video across all keys, looping, and prints the frame
+   rate achieved and where each frame's time went once a second. Frames that
+   can't be shown in time are dropped so the video keeps its speed.
+*/
+#include <SD.h>
+#include "streamdeck.h"
+
+#define VIDEO_FILE "/video.mjpeg"
+#define VIDEO_FPS 15
+
+USBHost myusb;
+USBHIDParser hid1(myusb);
+Streamdeck::StreamdeckController sdc1(myusb);
+
+// Holds the frame buffer, so keep it out of the stack.
+Streamdeck::VideoPlayer video(&sdc1);
+bool connected = false;
+uint32_t lastReport = 0;
+
+void report() {
+  const Streamdeck::video_stats_t *stats = video.getStats();
+  const uint32_t frames = max(stats->framesShown, 1UL);
+  Serial.printf("%.1f fps, %lu dropped; per frame: read %lu us, decode %lu "
+                "us, encode %lu us, queue %lu us\n",
+                video.getFps(), stats->framesDropped,
+                (uint32_t)(stats->readMicros / frames),
+                (uint32_t)(stats->decodeMicros / frames),
+                (uint32_t)(stats->encodeMicros / frames),
+                (uint32_t)(stats->queueMicros / frames));
+  video.resetStats();
+}
+
+void setup() {
+  Serial.begin(115200);
+  if (!SD.begin(BUILTIN_SDCARD))
+    Serial.println("No SD card found.");
+  myusb.begin();
+}
+
+void loop() {
+  myusb.Task();
+
+  if (sdc1 != connected) {
+    connected = sdc1;
+    if (connected) {
+      if (!video.play(VIDEO_FILE, VIDEO_FPS, true))
+        Serial.println("Couldn't open " VIDEO_FILE);
+      lastReport = millis();
+    } else {
+      video.close();
+    }
+  }
+
+  if (connected) {
+    sdc1.Task();
+    video.Task();
+    if (video.isPlaying() && millis() - lastReport >= 1000) {
+      lastReport = millis();
+      report();
+    }
+  }
+}
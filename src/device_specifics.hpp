@@ -25,6 +25,7 @@ Credit to:
          www.fourwalledcubicle.com
 */
 #pragma once
+#include "../streamdeck_config.hpp"
 #include <Arduino.h>
 
 #define USB_VID_ELGATO 0x0fd9U
@@ -51,6 +52,23 @@ enum key_rotation_t {
   ROTATE_270_DEGREES = 3
 };
 
+// Generation 1 decks (Original v1, Mini, Mini MK2) take BMP images behind a 16 byte
+// header and report key states after a 1 byte header. Generation 2 decks take
+// JPEG images behind an 8 byte header and report key states after 4 bytes.
+enum report_protocol_t { REPORT_PROTOCOL_GEN1 = 0, REPORT_PROTOCOL_GEN2 };
+
+// Stream Deck+ input reports carry one of these in their second byte.
+enum control_report_t {
+  CONTROL_REPORT_KEYS = 0x00,
+  CONTROL_REPORT_TOUCHSCREEN = 0x02,
+  CONTROL_REPORT_DIALS = 0x03
+};
+
+const uint8_t MAX_DIALS = 4;
+
+// Generation 1 decks take uncompressed 24-bit BMP files, stored bottom-up.
+const uint16_t BMP_HEADER_LENGTH = 54;
+
 enum control_type_t {
   CONTROL_TYPE_KEY = 0,
   CONTROL_TYPE_DIAL,
@@ -70,10 +88,101 @@ struct device_settings_t {
   key_rotation_t keyRotation;
   uint16_t imageReportLength;
   uint16_t imageReportHeaderLength;
+  report_protocol_t protocol;
+  uint8_t inputReportHeaderLength;
+  bool keyColsReversed;    // Device numbers keys right to left
+  uint16_t imageFirstPageLength; // Image bytes in page 0; 0 fills it
+  uint8_t imagePageBase;         // Number of the first image page
+  uint8_t dialCount;
+  uint8_t touchKeyCount; // Imageless keys reported after the regular ones
+  uint16_t screenWidth;  // Touch/info screen, 0 if none
+  uint16_t screenHeight;
+  bool screenRegions; // Screen takes partial updates; else whole images only
+  bool screenFlipH;
+  bool screenFlipV;
 };
 
-// For right now, only supporting devices with JPEG image format.
-const device_settings_t DeviceList[] = {
+constexpr device_settings_t DeviceList[] = {
+#if STREAMDECK_USBHOST_ENABLE_ORIGINAL_V1
+    {.productId = USB_PID_STREAMDECK_ORIGINAL,
+     .keyCount = 15,
+     .keyCols = 5,
+     .keyRows = 3,
+     .keyWidth = 72,
+     .keyHeight = 72,
+     .imageFormat = IMAGE_FORMAT_BITMAP,
+     .keyFlipH = true,
+     .keyFlipV = true,
+     .keyRotation = ROTATE_NONE,
+     .imageReportLength = 8191,
+     .imageReportHeaderLength = 16,
+     .protocol = REPORT_PROTOCOL_GEN1,
+     .inputReportHeaderLength = 1,
+     .keyColsReversed = true,
+     // The original takes the BMP header and the first 2583 pixels in page 0,
+     // as the Elgato software sends them (7803 of 15606 Bytes); the rest goes
+     // in the second page.
+     .imageFirstPageLength = BMP_HEADER_LENGTH + 2583 * 3,
+     .imagePageBase = 1,
+     .dialCount = 0,
+     .touchKeyCount = 0,
+     .screenWidth = 0,
+     .screenHeight = 0,
+     .screenRegions = false,
+     .screenFlipH = false,
+     .screenFlipV = false},
+#endif // STREAMDECK_USBHOST_ENABLE_ORIGINAL_V1
+#if STREAMDECK_USBHOST_ENABLE_MINI
+    {.productId = USB_PID_STREAMDECK_MINI,
+     .keyCount = 6,
+     .keyCols = 3,
+     .keyRows = 2,
+     .keyWidth = 80,
+     .keyHeight = 80,
+     .imageFormat = IMAGE_FORMAT_BITMAP,
+     .keyFlipH = false,
+     .keyFlipV = true,
+     .keyRotation = ROTATE_90_DEGREES,
+     .imageReportLength = 1024,
+     .imageReportHeaderLength = 16,
+     .protocol = REPORT_PROTOCOL_GEN1,
+     .inputReportHeaderLength = 1,
+     .keyColsReversed = false,
+     .imageFirstPageLength = 0,
+     .imagePageBase = 0,
+     .dialCount = 0,
+     .touchKeyCount = 0,
+     .screenWidth = 0,
+     .screenHeight = 0,
+     .screenRegions = false,
+     .screenFlipH = false,
+     .screenFlipV = false},
+    {.productId = USB_PID_STREAMDECK_MINI_MK2,
+     .keyCount = 6,
+     .keyCols = 3,
+     .keyRows = 2,
+     .keyWidth = 80,
+     .keyHeight = 80,
+     .imageFormat = IMAGE_FORMAT_BITMAP,
+     .keyFlipH = false,
+     .keyFlipV = true,
+     .keyRotation = ROTATE_90_DEGREES,
+     .imageReportLength = 1024,
+     .imageReportHeaderLength = 16,
+     .protocol = REPORT_PROTOCOL_GEN1,
+     .inputReportHeaderLength = 1,
+     .keyColsReversed = false,
+     .imageFirstPageLength = 0,
+     .imagePageBase = 0,
+     .dialCount = 0,
+     .touchKeyCount = 0,
+     .screenWidth = 0,
+     .screenHeight = 0,
+     .screenRegions = false,
+     .screenFlipH = false,
+     .screenFlipV = false},
+#endif // STREAMDECK_USBHOST_ENABLE_MINI
+#if STREAMDECK_USBHOST_ENABLE_ORIGINAL_V2
     {.productId = USB_PID_STREAMDECK_ORIGINAL_V2,
      .keyCount = 15,
      .keyCols = 5,
@@ -85,7 +194,21 @@ const device_settings_t DeviceList[] = {
      .keyFlipV = false,
      .keyRotation = ROTATE_180_DEGREES,
      .imageReportLength = 1024,
-     .imageReportHeaderLength = 8},
+     .imageReportHeaderLength = 8,
+     .protocol = REPORT_PROTOCOL_GEN2,
+     .inputReportHeaderLength = 4,
+     .keyColsReversed = false,
+     .imageFirstPageLength = 0,
+     .imagePageBase = 0,
+     .dialCount = 0,
+     .touchKeyCount = 0,
+     .screenWidth = 0,
+     .screenHeight = 0,
+     .screenRegions = false,
+     .screenFlipH = false,
+     .screenFlipV = false},
+#endif // STREAMDECK_USBHOST_ENABLE_ORIGINAL_V2
+#if STREAMDECK_USBHOST_ENABLE_MK2
     {.productId = USB_PID_STREAMDECK_MK2,
      .keyCount = 15,
      .keyCols = 5,
@@ -97,7 +220,21 @@ const device_settings_t DeviceList[] = {
      .keyFlipV = false,
      .keyRotation = ROTATE_180_DEGREES,
      .imageReportLength = 1024,
-     .imageReportHeaderLength = 8},
+     .imageReportHeaderLength = 8,
+     .protocol = REPORT_PROTOCOL_GEN2,
+     .inputReportHeaderLength = 4,
+     .keyColsReversed = false,
+     .imageFirstPageLength = 0,
+     .imagePageBase = 0,
+     .dialCount = 0,
+     .touchKeyCount = 0,
+     .screenWidth = 0,
+     .screenHeight = 0,
+     .screenRegions = false,
+     .screenFlipH = false,
+     .screenFlipV = false},
+#endif // STREAMDECK_USBHOST_ENABLE_MK2
+#if STREAMDECK_USBHOST_ENABLE_XL
     {.productId = USB_PID_STREAMDECK_XL,
      .keyCount = 32,
      .keyCols = 8,
@@ -109,6 +246,210 @@ const device_settings_t DeviceList[] = {
      .keyFlipV = false,
      .keyRotation = ROTATE_180_DEGREES,
      .imageReportLength = 1024,
-     .imageReportHeaderLength = 8}};
+     .imageReportHeaderLength = 8,
+     .protocol = REPORT_PROTOCOL_GEN2,
+     .inputReportHeaderLength = 4,
+     .keyColsReversed = false,
+     .imageFirstPageLength = 0,
+     .imagePageBase = 0,
+     .dialCount = 0,
+     .touchKeyCount = 0,
+     .screenWidth = 0,
+     .screenHeight = 0,
+     .screenRegions = false,
+     .screenFlipH = false,
+     .screenFlipV = false},
+#endif // STREAMDECK_USBHOST_ENABLE_XL
+#if STREAMDECK_USBHOST_ENABLE_PLUS
+    {.productId = USB_PID_STREAMDECK_PLUS,
+     .keyCount = 8,
+     .keyCols = 4,
+     .keyRows = 2,
+     .keyWidth = 120,
+     .keyHeight = 120,
+     .imageFormat = IMAGE_FORMAT_JPEG,
+     .keyFlipH = false,
+     .keyFlipV = false,
+     .keyRotation = ROTATE_NONE,
+     .imageReportLength = 1024,
+     .imageReportHeaderLength = 8,
+     .protocol = REPORT_PROTOCOL_GEN2,
+     .inputReportHeaderLength = 4,
+     .keyColsReversed = false,
+     .imageFirstPageLength = 0,
+     .imagePageBase = 0,
+     .dialCount = 4,
+     .touchKeyCount = 0,
+     .screenWidth = 800,
+     .screenHeight = 100,
+     .screenRegions = true,
+     .screenFlipH = false,
+     .screenFlipV = false},
+#endif // STREAMDECK_USBHOST_ENABLE_PLUS
+#if STREAMDECK_USBHOST_ENABLE_NEO
+    {.productId = USB_PID_STREAMDECK_NEO,
+     .keyCount = 8,
+     .keyCols = 4,
+     .keyRows = 2,
+     .keyWidth = 96,
+     .keyHeight = 96,
+     .imageFormat = IMAGE_FORMAT_JPEG,
+     .keyFlipH = true,
+     .keyFlipV = true,
+     .keyRotation = ROTATE_NONE,
+     .imageReportLength = 1024,
+     .imageReportHeaderLength = 8,
+     .protocol = REPORT_PROTOCOL_GEN2,
+     .inputReportHeaderLength = 4,
+     .keyColsReversed = false,
+     .imageFirstPageLength = 0,
+     .imagePageBase = 0,
+     .dialCount = 0,
+     .touchKeyCount = 2,
+     .screenWidth = 248,
+     .screenHeight = 58,
+     .screenRegions = false,
+     .screenFlipH = true,
+     .screenFlipV = true},
+#endif // STREAMDECK_USBHOST_ENABLE_NEO
+#if STREAMDECK_USBHOST_ENABLE_PEDAL
+    // No display: zero key size and image report length.
+    {.productId = USB_PID_STREAMDECK_PEDAL,
+     .keyCount = 3,
+     .keyCols = 3,
+     .keyRows = 1,
+     .keyWidth = 0,
+     .keyHeight = 0,
+     .imageFormat = IMAGE_FORMAT_JPEG,
+     .keyFlipH = false,
+     .keyFlipV = false,
+     .keyRotation = ROTATE_NONE,
+     .imageReportLength = 0,
+     .imageReportHeaderLength = 0,
+     .protocol = REPORT_PROTOCOL_GEN2,
+     .inputReportHeaderLength = 4,
+     .keyColsReversed = false,
+     .imageFirstPageLength = 0,
+     .imagePageBase = 0,
+     .dialCount = 0,
+     .touchKeyCount = 0,
+     .screenWidth = 0,
+     .screenHeight = 0,
+     .screenRegions = false,
+     .screenFlipH = false,
+     .screenFlipV = false},
+#endif // STREAMDECK_USBHOST_ENABLE_PEDAL
+};
+
+#if !STREAMDECK_USBHOST_ENABLE_ORIGINAL_V1 &&                                  \
+    !STREAMDECK_USBHOST_ENABLE_ORIGINAL_V2 && !STREAMDECK_USBHOST_ENABLE_MK2 && \
+    !STREAMDECK_USBHOST_ENABLE_MINI && !STREAMDECK_USBHOST_ENABLE_XL &&        \
+    !STREAMDECK_USBHOST_ENABLE_PLUS && !STREAMDECK_USBHOST_ENABLE_NEO &&       \
+    !STREAMDECK_USBHOST_ENABLE_PEDAL
+#error "Enable at least one Stream Deck model"
+#endif
+
+#if STREAMDECK_USBHOST_PEDAL_ONLY &&                                           \
+    (STREAMDECK_USBHOST_ENABLE_ORIGINAL_V1 ||                                  \
+     STREAMDECK_USBHOST_ENABLE_ORIGINAL_V2 || STREAMDECK_USBHOST_ENABLE_MK2 || \
+     STREAMDECK_USBHOST_ENABLE_MINI || STREAMDECK_USBHOST_ENABLE_XL ||         \
+     STREAMDECK_USBHOST_ENABLE_PLUS || STREAMDECK_USBHOST_ENABLE_NEO)
+#error "Pedal-only builds cannot enable models with a display"
+#endif
+
+// Compile-time traits of the enabled models. Buffers are sized from these, and
+// code paths only some models need test them first so they drop out of builds
+// without such a model.
+constexpr uint8_t DEVICE_COUNT = sizeof(DeviceList) / sizeof(DeviceList[0]);
+
+// With one model, its settings are known at compile time; see
+// StreamdeckController::device().
+constexpr bool SINGLE_DEVICE = DEVICE_COUNT == 1;
+
+constexpr uint16_t traitMax(const uint16_t a, const uint16_t b) {
+  return a > b ? a : b;
+}
+
+constexpr uint16_t maxInputKeys(const uint8_t i = 0) {
+  return i == DEVICE_COUNT
+             ? 0
+             : traitMax(DeviceList[i].keyCount + DeviceList[i].touchKeyCount,
+                        maxInputKeys(i + 1));
+}
+
+constexpr uint16_t maxImageReportLength(const uint8_t i = 0) {
+  return i == DEVICE_COUNT ? 0
+                           : traitMax(DeviceList[i].imageReportLength,
+                                      maxImageReportLength(i + 1));
+}
+
+constexpr uint8_t maxDialCount(const uint8_t i = 0) {
+  return i == DEVICE_COUNT
+             ? 0
+             : traitMax(DeviceList[i].dialCount, maxDialCount(i + 1));
+}
+
+constexpr uint32_t traitMax32(const uint32_t a, const uint32_t b) {
+  return a > b ? a : b;
+}
+
+constexpr uint32_t maxKeyPixels(const uint8_t i = 0) {
+  return i == DEVICE_COUNT
+             ? 0
+             : traitMax32((uint32_t)DeviceList[i].keyWidth *
+                              DeviceList[i].keyHeight,
+                          maxKeyPixels(i + 1));
+}
+
+constexpr uint32_t maxScreenPixels(const uint8_t i = 0) {
+  return i == DEVICE_COUNT
+             ? 0
+             : traitMax32((uint32_t)DeviceList[i].screenWidth *
+                              DeviceList[i].screenHeight,
+                          maxScreenPixels(i + 1));
+}
+
+constexpr bool anyProtocol(const report_protocol_t protocol,
+                           const uint8_t i = 0) {
+  return i < DEVICE_COUNT && (DeviceList[i].protocol == protocol ||
+                              anyProtocol(protocol, i + 1));
+}
+
+constexpr bool anyColsReversed(const uint8_t i = 0) {
+  return i < DEVICE_COUNT &&
+         (DeviceList[i].keyColsReversed || anyColsReversed(i + 1));
+}
+
+constexpr bool anyScreen(const uint8_t i = 0) {
+  return i < DEVICE_COUNT && (DeviceList[i].screenWidth || anyScreen(i + 1));
+}
+
+constexpr uint16_t MAX_INPUT_KEYS = maxInputKeys();
+constexpr uint16_t MAX_IMAGE_REPORT_LENGTH = maxImageReportLength();
+constexpr uint8_t MAX_DIAL_COUNT = maxDialCount();
+constexpr uint32_t MAX_KEY_PIXELS = maxKeyPixels();
+constexpr uint32_t MAX_SCREEN_PIXELS = maxScreenPixels();
+constexpr bool ANY_GEN1 = anyProtocol(REPORT_PROTOCOL_GEN1);
+constexpr bool ANY_COLS_REVERSED = anyColsReversed();
+constexpr bool ANY_SCREEN = anyScreen();
+
+inline uint32_t bmpRowLength(const uint16_t width) {
+  return ((uint32_t)width * 3 + 3) & ~3U;
+}
+
+inline uint32_t bmpFileLength(const uint16_t width, const uint16_t height) {
+  return BMP_HEADER_LENGTH + bmpRowLength(width) * height;
+}
+
+// Fills a BITMAPFILEHEADER + BITMAPINFOHEADER pair for a 24-bit image.
+inline void fillBmpHeader(uint8_t *header, const uint16_t width,
+                          const uint16_t height) {
+  const uint32_t fields[] = {
+      bmpFileLength(width, height), 0, BMP_HEADER_LENGTH, 40, width, height,
+      1U | (24U << 16), 0, bmpRowLength(width) * height, 3780, 3780, 0, 0};
+  header[0] = 'B';
+  header[1] = 'M';
+  memcpy(header + 2, fields, sizeof(fields));
+}
 
 } // namespace Streamdeck
\ No newline at end of file
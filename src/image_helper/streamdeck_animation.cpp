@@ -0,0 +1,295 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#include "streamdeck_animation.hpp"
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+namespace Streamdeck {
+
+// GIF delays under this are taken as "no delay given", and shown for
+// DEFAULT_FRAME_MS like browsers do.
+static const int MIN_FRAME_MS = 20;
+static const int DEFAULT_FRAME_MS = 100;
+
+// AnimatedGIF draw callback: composites one line of the current frame into
+// the destination rows that sample it. Transparent pixels leave what the
+// previous frames drew.
+void KeyAnimation::drawLine(GIFDRAW *pDraw) {
+  KeyAnimation *animation = (KeyAnimation *)pDraw->pUser;
+  const source_mapping_t *map = &animation->map;
+  animation->disposal = pDraw->ucDisposalMethod;
+
+  const int row = pDraw->iY + pDraw->y;
+  const int dyStart = firstMappedDestination(row, map->stepY);
+  const int dyEnd =
+      min(firstMappedDestination(row + 1, map->stepY), map->dstHeight);
+  const int dxStart = firstMappedDestination(pDraw->iX, map->stepX);
+  const int dxEnd =
+      min(firstMappedDestination(pDraw->iX + pDraw->iWidth, map->stepX),
+          map->dstWidth);
+  const int transparent =
+      pDraw->ucHasTransparency ? pDraw->ucTransparent : -1;
+
+  for (int dy = dyStart; dy < dyEnd; dy++) {
+    RGB565 *dst =
+        map->frameBuffer + (map->dstY + dy) * map->stride + map->dstX;
+    for (int dx = dxStart; dx < dxEnd; dx++) {
+      const uint8_t index =
+          pDraw->pPixels[mappedSource(dx, map->stepX) - pDraw->iX];
+      if (index != transparent)
+        dst[dx].val = pDraw->pPalette[index];
+    }
+  }
+}
+
+bool KeyAnimation::start(const RGB565 background) {
+  tgx::Image<RGB565> *im = image.getTGXImage();
+  const int canvasWidth = gif.getCanvasWidth();
+  const int canvasHeight = gif.getCanvasHeight();
+  if (!im->data() || canvasWidth <= 0 || canvasHeight <= 0) {
+    gif.close();
+    return false;
+  }
+
+  background_ = background;
+  fitSourceMapping(map, im->data(), im->width(), im->height(), canvasWidth,
+                   canvasHeight);
+  im->fillScreen(background);
+  loopsLeft = 0;
+  firstPass = true;
+  frameWidth = frameHeight = 0;
+  disposal = 0;
+  opened = true;
+  return true;
+}
+
+bool KeyAnimation::open(const uint8_t *gifData, const uint32_t length,
+                        const RGB565 background) {
+  close();
+  gif.begin(GIF_PALETTE_RGB565_LE);
+  if (!gif.open((uint8_t *)gifData, length, drawLine))
+    return false;
+  return start(background);
+}
+
+void KeyAnimation::close() {
+  if (opened)
+    gif.close();
+  opened = false;
+}
+
+// Applies the last frame's disposal to the image.
+void KeyAnimation::disposeFrame() {
+  if (disposal == 2 && frameWidth > 0 && frameHeight > 0) {
+    const int minX = firstMappedDestination(frameX, map.stepX);
+    const int maxX =
+        min(firstMappedDestination(frameX + frameWidth, map.stepX),
+            map.dstWidth) - 1;
+    const int minY = firstMappedDestination(frameY, map.stepY);
+    const int maxY =
+        min(firstMappedDestination(frameY + frameHeight, map.stepY),
+            map.dstHeight) - 1;
+    if (minX <= maxX && minY <= maxY)
+      image.getTGXImage()->fillRect(
+          tgx::iBox2(map.dstX + minX, map.dstX + maxX, map.dstY + minY,
+                     map.dstY + maxY),
+          background_);
+  }
+  disposal = 0;
+}
+
+// Called once a pass has played its last frame: starts over with a clear
+// canvas, or stops.
+void KeyAnimation::endPass() {
+  // The NETSCAPE extension comes before the first frame, so its loop count is
+  // only known once a frame has been played. Without one the GIF plays once
+  // (AnimatedGIF reports -1); only an explicit 0 means forever.
+  if (firstPass) {
+    const int loopCount = gif.getLoopCount();
+    loopsLeft = loopCount < 0 ? 1 : loopCount;
+    firstPass = false;
+  }
+
+  if (loopsLeft == 1) {
+    loopsLeft = -1;
+    return;
+  }
+  if (loopsLeft > 1)
+    loopsLeft--;
+  gif.reset();
+  frameX = frameY = 0;
+  frameWidth = gif.getCanvasWidth();
+  frameHeight = gif.getCanvasHeight();
+  disposal = 2;
+}
+
+int32_t KeyAnimation::nextFrame() {
+  // A GIF that claims a frame more than it has ends its pass on an empty
+  // frame, which draws nothing; the next pass's first frame is shown instead.
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    if (!opened || loopsLeft < 0)
+      return -1;
+
+    disposeFrame();
+    int delay = 0;
+    const int result = gif.playFrame(false, &delay, this);
+    if (result < 0) {
+      close();
+      return -1;
+    }
+
+    // The frame geometry is stale unless a frame was drawn.
+    const bool drawn = gif.getLastError() != GIF_EMPTY_FRAME;
+    if (drawn) {
+      frameX = gif.getFrameXOff();
+      frameY = gif.getFrameYOff();
+      frameWidth = gif.getFrameWidth();
+      frameHeight = gif.getFrameHeight();
+    }
+
+    // After the last frame, show it before starting over.
+    if (result == 0)
+      endPass();
+    if (drawn)
+      return delay < MIN_FRAME_MS ? DEFAULT_FRAME_MS : delay;
+  }
+
+  // Two empty frames in a row: there is nothing to draw.
+  close();
+  return -1;
+}
+
+#if STREAMDECK_IMAGE_HELPER_USE_SD
+// AnimatedGIF opens files through callbacks. The handle is the animation's
+// File, opened by path.
+static File *gifOpenFile = nullptr;
+
+static void *gifFileOpen(const char *filename, int32_t *size) {
+  *gifOpenFile = SD.open(filename);
+  if (!*gifOpenFile)
+    return nullptr;
+  *size = gifOpenFile->size();
+  return gifOpenFile;
+}
+
+static void gifFileClose(void *handle) { ((File *)handle)->close(); }
+
+static int32_t gifFileRead(GIFFILE *handle, uint8_t *buffer, int32_t length) {
+  return ((File *)handle->fHandle)->read(buffer, length);
+}
+
+static int32_t gifFileSeek(GIFFILE *handle, int32_t position) {
+  return ((File *)handle->fHandle)->seek(position) ? position : -1;
+}
+
+bool KeyAnimation::open(const char *filePath, const RGB565 background) {
+  close();
+  if (!SD.exists(filePath))
+    return false;
+
+  gif.begin(GIF_PALETTE_RGB565_LE);
+  gifOpenFile = &file;
+  const int result = gif.open(filePath, gifFileOpen, gifFileClose, gifFileRead,
+                              gifFileSeek, drawLine);
+  gifOpenFile = nullptr;
+  if (!result)
+    return false;
+  return start(background);
+}
+#endif // STREAMDECK_IMAGE_HELPER_USE_SD
+
+int AnimationScheduler::findSlot(const uint16_t keyIndex) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (slots[i].keyIndex == keyIndex)
+      return i;
+  }
+  return -1;
+}
+
+void AnimationScheduler::removeSlot(const uint8_t slot) {
+  slots[slot] = slots[--count];
+}
+
+bool AnimationScheduler::play(KeyAnimation *animation,
+                              const uint16_t keyIndex) {
+  if (!animation || !animation->isOpen())
+    return false;
+
+  int slot = findSlot(keyIndex);
+  if (slot < 0) {
+    if (count >= STREAMDECK_IMAGE_HELPER_ANIMATION_SLOTS)
+      return false;
+    slot = count++;
+  }
+  slots[slot].animation = animation;
+  slots[slot].keyIndex = keyIndex;
+  slots[slot].due = millis();
+  return true;
+}
+
+void AnimationScheduler::stop(const uint16_t keyIndex) {
+  const int slot = findSlot(keyIndex);
+  if (slot >= 0)
+    removeSlot(slot);
+}
+
+bool AnimationScheduler::isPlaying(const uint16_t keyIndex) {
+  return findSlot(keyIndex) >= 0;
+}
+
+uint8_t AnimationScheduler::Task() {
+  // Pick the most overdue animation.
+  const uint32_t now = millis();
+  int next = -1;
+  int32_t lateness = -1;
+  for (uint8_t i = 0; i < count; i++) {
+    const int32_t late = (int32_t)(now - slots[i].due);
+    if (late > lateness) {
+      lateness = late;
+      next = i;
+    }
+  }
+  if (next < 0)
+    return count;
+
+  animation_slot_t &slot = slots[next];
+  const int32_t delay = slot.animation->nextFrame();
+  if (delay < 0) {
+    removeSlot(next);
+    return count;
+  }
+  slot.animation->getImage()->sendToKey(sdc_, slot.keyIndex);
+
+  // Keep the GIF's own cadence, unless we're already a whole frame behind.
+  slot.due += delay;
+  if ((int32_t)(now - slot.due) > 0)
+    slot.due = now;
+  return count;
+}
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
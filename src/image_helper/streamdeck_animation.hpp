@@ -0,0 +1,138 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../device_specifics.hpp"
+#include "../../streamdeck_config.hpp"
+#include "../usbhost_driver/streamdeck_usb.hpp"
+#include "streamdeck_graphics.hpp"
+#include "streamdeck_mapping.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+#include <AnimatedGIF.h>
+#include <tgx.h>
+
+#if STREAMDECK_IMAGE_HELPER_USE_SD
+#include <SD.h>
+#endif // STREAMDECK_IMAGE_HELPER_USE_SD
+
+namespace Streamdeck {
+
+// Plays an animated GIF on one key. Frames are decoded one at a time, straight
+// from RAM or SD, and only each frame's own rectangle is composited (scaled to
+// fit) into the key image, so the GIF is never held decoded. Each animation
+// owns its GIF decoder, so keep as many around as you play at once.
+class KeyAnimation {
+public:
+  KeyAnimation(device_settings_t *settings) : image(settings) {}
+  ~KeyAnimation() { close(); }
+
+  // Transparent pixels and letterboxing show background. Returns false if the
+  // GIF can't be opened or the image has no framebuffer.
+  bool open(const uint8_t *gifData, const uint32_t length,
+            RGB565 background = tgx::RGB565_Black);
+#if STREAMDECK_IMAGE_HELPER_USE_SD
+  bool open(const char *filePath, RGB565 background = tgx::RGB565_Black);
+#endif // STREAMDECK_IMAGE_HELPER_USE_SD
+  void close();
+  bool isOpen() { return opened; }
+
+  // Composites the next frame into the image. Returns how long it should be
+  // shown for in milliseconds, or -1 once the GIF has played its loops (or
+  // failed). GIFs loop as many times as their NETSCAPE extension asks, with 0
+  // meaning forever; a GIF without one plays once.
+  int32_t nextFrame();
+
+  Image *getImage() { return &image; }
+
+private:
+  bool start(const RGB565 background);
+  void disposeFrame();
+  void endPass();
+  static void drawLine(GIFDRAW *pDraw);
+
+  AnimatedGIF gif;
+  Image image;
+  source_mapping_t map;
+  RGB565 background_ = tgx::RGB565_Black;
+  bool opened = false;
+  // Passes left including the current one, 0 for forever, or -1 once done.
+  // Unknown until the first pass ends.
+  int loopsLeft = 0;
+  bool firstPass = true;
+
+  // The last frame's canvas rectangle and disposal method. Method 2 clears
+  // the rectangle to the background before the next frame.
+  int frameX = 0;
+  int frameY = 0;
+  int frameWidth = 0;
+  int frameHeight = 0;
+  uint8_t disposal = 0;
+
+#if STREAMDECK_IMAGE_HELPER_USE_SD
+  File file;
+#endif // STREAMDECK_IMAGE_HELPER_USE_SD
+};
+
+// Plays KeyAnimations on a controller's keys, each on its frames' own delays.
+// Call Task() from loop(): each call decodes and sends at most the one frame
+// that is most overdue, so a busy scheduler never holds up input handling.
+// Animations that fall behind are slowed down rather than skipping frames,
+// which GIFs can't do without decoding them anyway.
+class AnimationScheduler {
+public:
+  AnimationScheduler(StreamdeckController *sdc) : sdc_(sdc) {}
+
+  // Starts playing an open animation on a key at once, replacing whatever
+  // that key was playing. Returns false if every slot is taken.
+  bool play(KeyAnimation *animation, const uint16_t keyIndex);
+  void stop(const uint16_t keyIndex);
+  void stopAll() { count = 0; }
+  bool isPlaying(const uint16_t keyIndex);
+
+  // Returns the number of animations still playing.
+  uint8_t Task();
+
+private:
+  struct animation_slot_t {
+    KeyAnimation *animation;
+    uint16_t keyIndex;
+    uint32_t due; // millis() at which the next frame is sent
+  };
+
+  int findSlot(const uint16_t keyIndex);
+  void removeSlot(const uint8_t slot);
+
+  StreamdeckController *sdc_;
+  animation_slot_t slots[STREAMDECK_IMAGE_HELPER_ANIMATION_SLOTS];
+  uint8_t count = 0;
+};
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
@@ -0,0 +1,274 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#include "streamdeck_directory.hpp"
+#if STREAMDECK_IMAGE_HELPER_ENABLE && STREAMDECK_IMAGE_HELPER_USE_SD
+
+#include <Entropy.h>
+
+namespace Streamdeck {
+
+// A saved index is this header followed by count entries.
+struct index_header_t {
+  uint32_t magic;
+  uint16_t nameLength; // STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH when saved
+  uint16_t count;
+};
+
+static const uint32_t INDEX_MAGIC = 0x58494453; // "SDIX"
+
+static bool joinPath(char *out, const size_t outLength, const char *directory,
+                     const char *name) {
+  const size_t length = strlen(directory);
+  const char *separator = length && directory[length - 1] == '/' ? "" : "/";
+  return (size_t)snprintf(out, outLength, "%s%s%s", directory, separator,
+                          name) < outLength;
+}
+
+// Only ever compared, so any packing that keeps the fields apart will do.
+static uint32_t packModifyTime(File &file) {
+  DateTimeFields tm;
+  if (!file.getModifyTime(tm))
+    return 0;
+  return (uint32_t)(tm.year & 0x7f) << 25 | (uint32_t)(tm.mon & 0xf) << 21 |
+         (uint32_t)(tm.mday & 0x1f) << 16 | (tm.hour & 0x1f) << 11 |
+         (tm.min & 0x3f) << 5 | tm.sec >> 1;
+}
+
+// Reads a JPEG's dimensions from its frame header, seeking past the segments
+// before it (EXIF data included) rather than reading them. Returns false if
+// the file isn't a JPEG.
+static bool readJpegSize(File &file, uint16_t &width, uint16_t &height) {
+  uint8_t bytes[9];
+  if (file.read(bytes, 2) != 2 || bytes[0] != 0xff || bytes[1] != 0xd8)
+    return false;
+
+  uint32_t pos = 2;
+  for (;;) {
+    if (file.read(bytes, 4) != 4 || bytes[0] != 0xff)
+      return false;
+    const uint8_t marker = bytes[1];
+    if (marker == 0xff) {
+      // Fill byte
+      if (!file.seek(++pos))
+        return false;
+      continue;
+    }
+    if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 &&
+        marker != 0xc8 && marker != 0xcc) {
+      // SOFn: precision, height, width
+      if (file.read(bytes + 4, 5) != 5)
+        return false;
+      height = bytes[5] << 8 | bytes[6];
+      width = bytes[7] << 8 | bytes[8];
+      return width && height;
+    }
+
+    const uint16_t length = bytes[2] << 8 | bytes[3];
+    if (marker == 0xda || marker == 0xd9 || length < 2)
+      return false;
+    pos += 2 + length;
+    if (!file.seek(pos))
+      return false;
+  }
+}
+
+// Looks for name among the saved entries still unread, and on a match leaves
+// the index positioned just past it. Entries skipped on the way are for files
+// that are gone, so one deleted file costs a look ahead rather than making
+// every file after it miss. Without a match the file is new, and the position
+// is put back.
+static bool findCached(File &cache, uint16_t &cacheLeft, const char *name,
+                       image_index_entry_t &cached) {
+  const uint32_t start = cache.position();
+  for (uint16_t i = 0; i < cacheLeft; i++) {
+    if (cache.read(&cached, sizeof(cached)) != sizeof(cached))
+      break;
+    if (!strncmp(cached.name, name, sizeof(cached.name))) {
+      cacheLeft -= i + 1;
+      return true;
+    }
+  }
+  cache.seek(start);
+  return false;
+}
+
+bool ImageDirectory::open(const char *directory, const bool persist) {
+  count = 0;
+  next = 0;
+  path[0] = 0;
+  this->persist = persist;
+  if (strlen(directory) >= INDEX_PATH_LENGTH)
+    return false;
+
+  File dir = SD.open(directory);
+  if (!dir || !dir.isDirectory())
+    return false;
+  strcpy(path, directory);
+
+  // The saved index is read alongside the directory walk. Directory order
+  // only changes when files are added or removed, so each file's entry is
+  // normally the next one.
+  char cachePath[INDEX_PATH_LENGTH + sizeof(STREAMDECK_INDEX_FILE_NAME)];
+  File cache;
+  uint16_t cacheLeft = 0;
+  if (persist && joinPath(cachePath, sizeof(cachePath), path,
+                          STREAMDECK_INDEX_FILE_NAME))
+    cache = SD.open(cachePath);
+  if (cache) {
+    index_header_t header;
+    if (cache.read(&header, sizeof(header)) == sizeof(header) &&
+        header.magic == INDEX_MAGIC &&
+        header.nameLength == STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH)
+      cacheLeft = header.count;
+  }
+  image_index_entry_t cached;
+  bool changed = false;
+
+  while (File file = dir.openNextFile()) {
+    if (count >= STREAMDECK_IMAGE_HELPER_INDEX_ENTRIES)
+      break;
+    const char *name = file.name();
+    if (file.isDirectory() ||
+        strlen(name) >= STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH ||
+        !strcmp(name, STREAMDECK_INDEX_FILE_NAME))
+      continue;
+
+    image_index_entry_t &entry = entries[count];
+    strcpy(entry.name, name);
+    entry.size = file.size();
+    entry.modified = packModifyTime(file);
+
+    const uint16_t unread = cacheLeft;
+    const bool found = cache && findCached(cache, cacheLeft, name, cached);
+    if (found && unread - cacheLeft > 1)
+      changed = true;
+    if (found && cached.size == entry.size &&
+        cached.modified == entry.modified) {
+      entry.width = cached.width;
+      entry.height = cached.height;
+    } else if (readJpegSize(file, entry.width, entry.height)) {
+      changed = true;
+    } else {
+      continue; // Not a JPEG
+    }
+    count++;
+  }
+
+  // Saved entries that were never matched are for files that are gone.
+  if (cacheLeft)
+    changed = true;
+  if (cache)
+    cache.close();
+  dir.close();
+
+  if (persist && changed)
+    saveIndex();
+  return true;
+}
+
+void ImageDirectory::saveIndex() {
+  char cachePath[INDEX_PATH_LENGTH + sizeof(STREAMDECK_INDEX_FILE_NAME)];
+  if (!joinPath(cachePath, sizeof(cachePath), path,
+                STREAMDECK_INDEX_FILE_NAME))
+    return;
+
+  SD.remove(cachePath);
+  File cache = SD.open(cachePath, FILE_WRITE);
+  if (!cache)
+    return;
+  const index_header_t header = {
+      INDEX_MAGIC, STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH, count};
+  cache.write((const uint8_t *)&header, sizeof(header));
+  cache.write((const uint8_t *)entries, count * sizeof(entries[0]));
+  cache.close();
+}
+
+bool ImageDirectory::refresh() {
+  // open() clears path before copying the directory into it.
+  char directory[INDEX_PATH_LENGTH];
+  strcpy(directory, path);
+  return directory[0] && open(directory, persist);
+}
+
+File ImageDirectory::openEntry(const uint16_t index) {
+  char filePath[INDEX_PATH_LENGTH + STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH];
+  if (index >= count ||
+      !joinPath(filePath, sizeof(filePath), path, entries[index].name))
+    return File();
+  return SD.open(filePath);
+}
+
+bool ImageDirectory::importJpeg(Image *image, const uint16_t index) {
+  if (!image)
+    return false;
+
+  File file = openEntry(index);
+  if (!file)
+    return false;
+  const bool result = image->importJpeg(file);
+  file.close();
+  return result;
+}
+
+// Imports a random or the next image. A picked file that can't be opened
+// means the directory changed since it was indexed, so it is indexed again
+// and the pick made once more.
+bool ImageDirectory::importPicked(Image *image, const bool random) {
+  if (!image)
+    return false;
+
+  for (uint8_t attempt = 0; attempt < 2 && count; attempt++) {
+    uint16_t index = next;
+    if (random) {
+      index = Entropy.random(count);
+    } else {
+      next = (next + 1) % count;
+    }
+
+    File file = openEntry(index);
+    if (file) {
+      const bool result = image->importJpeg(file);
+      file.close();
+      return result;
+    }
+    if (!refresh())
+      return false;
+  }
+  return false;
+}
+
+bool ImageDirectory::importRandom(Image *image) {
+  return importPicked(image, true);
+}
+
+bool ImageDirectory::importNext(Image *image) {
+  return importPicked(image, false);
+}
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE && STREAMDECK_IMAGE_HELPER_USE_SD
@@ -0,0 +1,96 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../device_specifics.hpp"
+#include "../../streamdeck_config.hpp"
+#include "streamdeck_graphics.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_IMAGE_HELPER_ENABLE && STREAMDECK_IMAGE_HELPER_USE_SD
+
+#include <SD.h>
+
+namespace Streamdeck {
+
+// Longest directory path an ImageDirectory takes, including the terminator.
+const uint8_t INDEX_PATH_LENGTH = 64;
+
+// Name of the index an ImageDirectory saves into the directory it indexes.
+#define STREAMDECK_INDEX_FILE_NAME "_images.idx"
+
+struct image_index_entry_t {
+  char name[STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH];
+  uint32_t size;
+  uint32_t modified; // Packed date and time, for spotting changed files
+  uint16_t width;
+  uint16_t height;
+};
+
+// An index of the JPEGs in one SD directory, built once so that picking an
+// image takes a single file open instead of a walk through the directory.
+// Entries hold each file's name, size, modification time and dimensions.
+//
+// Building the index opens every file to read its JPEG header. With persist
+// set the index is also saved into the directory, and the next open() reuses
+// the dimensions of every file whose name, size and modification time still
+// match, so only new or changed files are read again.
+//
+// The index isn't kept up to date by itself: call refresh() after files were
+// added, removed or changed. importRandom() and importNext() refresh on their
+// own when the file they picked is gone.
+class ImageDirectory {
+public:
+  bool open(const char *directory, const bool persist = false);
+  // Indexes the same directory again.
+  bool refresh();
+  const char *getPath() { return path; }
+  uint16_t getCount() { return count; }
+  const image_index_entry_t *getEntry(const uint16_t index) {
+    return index < count ? &entries[index] : nullptr;
+  }
+
+  // Imports an indexed JPEG into the image. Fails if the file is gone.
+  bool importJpeg(Image *image, const uint16_t index);
+  bool importRandom(Image *image);
+  // Steps through the images in directory order, wrapping around.
+  bool importNext(Image *image);
+
+private:
+  File openEntry(const uint16_t index);
+  bool importPicked(Image *image, const bool random);
+  void saveIndex();
+
+  char path[INDEX_PATH_LENGTH] = {};
+  bool persist = false;
+  image_index_entry_t entries[STREAMDECK_IMAGE_HELPER_INDEX_ENTRIES];
+  uint16_t count = 0;
+  uint16_t next = 0;
+};
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE && STREAMDECK_IMAGE_HELPER_USE_SD
@@ -25,6 +25,7 @@ Credit to:
          www.fourwalledcubicle.com
 */
 #include "streamdeck_graphics.hpp"
+#include "streamdeck_directory.hpp"
 #if STREAMDECK_IMAGE_HELPER_ENABLE
 
 #include <Entropy.h>
@@ -41,77 +42,364 @@ tgx::Image<tgx::RGB565> outboundSprite;
 
 // Allocate a framebuffer of the appropriate size if not provided
 void Image::allocateFrameBuffer(const uint16_t width, const uint16_t height) {
-  frameBuffer_ = (RGB565 *)calloc(width * height, sizeof(RGB565));
+  frameBuffer_ = acquireFrameBuffer((uint32_t)width * height);
   madeFrameBuffer = true;
 }
 
 // Only frees the framebuffer if Image class created it.
 void Image::freeFrameBuffer() {
   if (madeFrameBuffer)
-    free(frameBuffer_);
+    releaseFrameBuffer(frameBuffer_);
+}
+
+// JPEGDEC draw callback: writes the destination pixels that sample this block.
+static int jpegDrawMapped(JPEGDRAW *pDraw) {
+  const source_mapping_t *map = (const source_mapping_t *)pDraw->pUser;
+  const int dxStart = firstMappedDestination(pDraw->x, map->stepX);
+  const int dxEnd =
+      min(firstMappedDestination(pDraw->x + pDraw->iWidthUsed, map->stepX),
+          map->dstWidth);
+  const int dyStart = firstMappedDestination(pDraw->y, map->stepY);
+  const int dyEnd =
+      min(firstMappedDestination(pDraw->y + pDraw->iHeight, map->stepY),
+          map->dstHeight);
+
+  for (int dy = dyStart; dy < dyEnd; dy++) {
+    const uint16_t *src =
+        pDraw->pPixels +
+        (mappedSource(dy, map->stepY) - pDraw->y) * pDraw->iWidth - pDraw->x;
+    RGB565 *dst =
+        map->frameBuffer + (map->dstY + dy) * map->stride + map->dstX;
+    for (int dx = dxStart; dx < dxEnd; dx++) {
+      dst[dx].val = src[mappedSource(dx, map->stepX)];
+    }
+  }
+  return 1;
+}
+
+void Image::setFrameBuffer(RGB565 *frameBuffer, device_settings_t *settings) {
+  freeFrameBuffer();
+  madeFrameBuffer = false;
+  useDeviceOrientation(settings);
+  width_ = settings->keyWidth;
+  height_ = settings->keyHeight;
+  frameBuffer_ = frameBuffer;
+  im = tgx::Image<tgx::RGB565>(frameBuffer_, width_, height_);
+}
+
+uint8_t Image::decodeScaleShift(const int srcWidth, const int srcHeight) {
+  return jpegScaleShift(srcWidth, srcHeight, width_, height_);
+}
+
+#if STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS
+// Camera and phone JPEGs usually embed a small EXIF thumbnail. When it still
+// covers our framebuffer it gives the same key image for a fraction of the
+// decoding. Thumbnails letterboxed to a different aspect ratio than the main
+// image are skipped, as their bars would show.
+bool Image::useExifThumbnail(JPEGDEC *decoder, const int width,
+                             const int height) {
+  if (!decoder->hasThumb())
+    return false;
+
+  const int thumbWidth = decoder->getThumbWidth();
+  const int thumbHeight = decoder->getThumbHeight();
+  if (thumbWidth <= 0 || thumbHeight <= 0 || thumbWidth >= width)
+    return false;
+
+  // Aspect ratios within 2% of each other.
+  const int32_t cross = (int32_t)thumbWidth * height;
+  const int32_t other = (int32_t)thumbHeight * width;
+  if (abs(cross - other) * 50 > other)
+    return false;
+
+  return fitsToWidth(thumbWidth, thumbHeight, width_, height_)
+             ? thumbWidth >= width_
+             : thumbHeight >= height_;
+}
+#endif // STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS
+
+// Decodes the JPEG the decoder has open, fitted and centred in our
+// framebuffer, then closes and releases the decoder. Images smaller than the
+// framebuffer are centred unscaled. No source-sized buffer is needed: each
+// decoded block is scaled into place.
+bool Image::decodeJpeg(JPEGDEC *decoder) {
+  int width = decoder->getWidth(), height = decoder->getHeight();
+  int options = 0;
+
+#if STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS
+  if (useExifThumbnail(decoder, width, height)) {
+    width = decoder->getThumbWidth();
+    height = decoder->getThumbHeight();
+    options = JPEG_EXIF_THUMBNAIL;
+  }
+#endif // STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS
+
+  const uint8_t shift = decodeScaleShift(width, height);
+  static const int scaleOptions[] = {0, JPEG_SCALE_HALF, JPEG_SCALE_QUARTER,
+                                     JPEG_SCALE_EIGHTH};
+  options |= scaleOptions[shift];
+  const int round = (1 << shift) - 1;
+  const int srcWidth = (width + round) >> shift;
+  const int srcHeight = (height + round) >> shift;
+
+  source_mapping_t map;
+  fitSourceMapping(map, frameBuffer_, width_, height_, srcWidth, srcHeight);
+
+  bool result = false;
+  if (frameBuffer_) {
+    decoder->setUserPointer(&map);
+    result = decoder->decode(0, 0, options);
+  }
+  decoder->close();
+  releaseJpegDecoder(decoder);
+  return result;
 }
 
 bool Image::importJpeg(const uint8_t *inBuffer, const uint16_t inLength) {
+  JPEGDEC *decoder = acquireJpegDecoder();
+  if (!decoder)
+    return false;
   // Load JPEGDEC to process the jpeg headers
-  if (!jpgDecoder.openRAM((uint8_t *)inBuffer, inLength, TGX_JPEGDraw)) {
+  if (!decoder->openRAM((uint8_t *)inBuffer, inLength, jpegDrawMapped)) {
+    releaseJpegDecoder(decoder);
     return false;
   }
+  return decodeJpeg(decoder);
+}
 
-  // Create temporary framebuffer to hold the image until we downscale and blit
-  // it into our main framebuffer
-  int tempWidth = jpgDecoder.getWidth(), tempHeight = jpgDecoder.getHeight();
-  RGB565 *tempFb = (RGB565 *)malloc(tempWidth * tempHeight * sizeof(RGB565));
-  tgx::Image<tgx::RGB565> tempImg(tempFb, tempWidth, tempHeight);
-
-  // Use tgx shortcuts for JPEGDEC to process the data into our framebuffer
-  uint8_t result = tempImg.JPEGDecode(jpgDecoder, tgx::iVec2(0, 0));
-  jpgDecoder.close();
+// What pngDrawMapped needs per line: the decoder, a line of RGB565 pixels,
+// where they go and the colour transparent pixels are blended with.
+struct png_draw_t {
+  PNG *decoder;
+  uint16_t *line;
+  source_mapping_t map;
+  uint32_t background; // PNGdec's 0x00BBGGRR
+};
+
+// PNGdec draw callback: converts this line only if some destination row
+// samples it, then writes that row (or rows, when enlarging).
+static int pngDrawMapped(PNGDRAW *pDraw) {
+  const png_draw_t *draw = (const png_draw_t *)pDraw->pUser;
+  const source_mapping_t *map = &draw->map;
+  const int dyStart = firstMappedDestination(pDraw->y, map->stepY);
+  const int dyEnd =
+      min(firstMappedDestination(pDraw->y + 1, map->stepY), map->dstHeight);
+  if (dyStart >= dyEnd)
+    return 1;
+
+  draw->decoder->getLineAsRGB565(pDraw, draw->line, PNG_RGB565_LITTLE_ENDIAN,
+                                 draw->background);
+  for (int dy = dyStart; dy < dyEnd; dy++) {
+    RGB565 *dst =
+        map->frameBuffer + (map->dstY + dy) * map->stride + map->dstX;
+    for (int dx = 0; dx < map->dstWidth; dx++) {
+      dst[dx].val = draw->line[mappedSource(dx, map->stepX)];
+    }
+  }
+  return 1;
+}
 
-  if (!result) {
-    // If it fails, make sure we free the malloc
-    free(tempFb);
+// Decodes the PNG the decoder has open, fitted and centred like decodeJpeg,
+// then closes and releases the decoder. Only one source line is held at a
+// time, and pixels with alpha are blended over background, which also fills
+// any letterboxing.
+bool Image::decodePng(PNG *decoder, const RGB565 background) {
+  const int srcWidth = decoder->getWidth();
+  const int srcHeight = decoder->getHeight();
+
+  png_draw_t draw;
+  draw.decoder = decoder;
+  draw.line = nullptr;
+  if (frameBuffer_ && srcWidth > 0 && srcHeight > 0)
+    draw.line = (uint16_t *)acquireScratch((uint32_t)srcWidth * 2);
+  if (!draw.line) {
+    decoder->close();
+    releasePngDecoder(decoder);
     return false;
   }
 
-  blitWithScalingAndAutorotation(tempImg);
-
-  // Having blitted, we can now remove the temp framebuffer.
-  free(tempFb);
+  fitSourceMapping(draw.map, frameBuffer_, width_, height_, srcWidth,
+                   srcHeight);
+  if (draw.map.dstWidth < width_ || draw.map.dstHeight < height_)
+    im.fillScreen(background);
+
+  // RGB565 to 8 bits per channel, red in the low byte as PNGdec expects.
+  const uint32_t r = background.R << 3, g = background.G << 2,
+                 b = background.B << 3;
+  draw.background = (r | r >> 5) | (g | g >> 6) << 8 | (b | b >> 5) << 16;
+
+  const bool result = decoder->decode(&draw, 0) == PNG_SUCCESS;
+  decoder->close();
+  releasePngDecoder(decoder);
+  releaseScratch(draw.line);
+  return result;
+}
 
-  return true;
+bool Image::importPng(const uint8_t *buffer, const uint16_t bufferLen,
+                      const RGB565 background) {
+  PNG *decoder = acquirePngDecoder();
+  if (!decoder)
+    return false;
+  if (decoder->openRAM((uint8_t *)buffer, bufferLen, pngDrawMapped) !=
+      PNG_SUCCESS) {
+    releasePngDecoder(decoder);
+    return false;
+  }
+  return decodePng(decoder, background);
 }
 
 size_t Image::exportJpeg(uint8_t *outBuffer, uint16_t outLength) {
+  JPEGENC *encoder = acquireJpegEncoder();
+  if (!encoder || !frameBuffer_) {
+    releaseJpegEncoder(encoder);
+    return 0;
+  }
+
   JPEGENCODE jpe;
+  const int width = nativeWidth(), height = nativeHeight();
+
+  encoder->open(outBuffer, outLength);
+  encoder->encodeBegin(&jpe, width, height, JPEGE_PIXEL_RGB565,
+                       JPEGE_SUBSAMPLE_444, JPEGE_Q_HIGH);
 
-  jpgEncoder.open(outBuffer, outLength);
-  jpgEncoder.encodeBegin(&jpe, width_, height_, JPEGE_PIXEL_RGB565,
-                         JPEGE_SUBSAMPLE_444, JPEGE_Q_HIGH);
-  jpgEncoder.addFrame(&jpe, (uint8_t *)frameBuffer_, width_ * 2);
-  return jpgEncoder.close();
+  if (nativeRotation == ROTATE_NONE && !nativeFlipH && !nativeFlipV) {
+    encoder->addFrame(&jpe, (uint8_t *)frameBuffer_, width_ * 2);
+  } else {
+    // Gather each 8x8 MCU in device orientation by walking the framebuffer
+    // with the orientation's strides. Edge MCUs repeat the last row/column.
+    const int32_t origin = nativeToFrameBufferIndex(0, 0);
+    const int32_t stepX = nativeToFrameBufferIndex(1, 0) - origin;
+    const int32_t stepY = nativeToFrameBufferIndex(0, 1) - origin;
+    uint16_t mcu[8 * 8];
+
+    for (int mcuY = 0; mcuY < height; mcuY += 8) {
+      for (int mcuX = 0; mcuX < width; mcuX += 8) {
+        for (int y = 0; y < 8; y++) {
+          const RGB565 *src =
+              frameBuffer_ + origin + min(mcuY + y, height - 1) * stepY;
+          for (int x = 0; x < 8; x++) {
+            mcu[y * 8 + x] = src[min(mcuX + x, width - 1) * stepX].val;
+          }
+        }
+        encoder->addMCU(&jpe, (uint8_t *)mcu, 8 * sizeof(uint16_t));
+      }
+    }
+  }
+
+  const size_t length = encoder->close();
+  releaseJpegEncoder(encoder);
+  return length;
 }
 
-void Image::blitWithScalingAndAutorotation(tgx::Image<tgx::RGB565> srcImg) {
-  // Determine centre-points for our blitting routines.
-  coord thisCentre(width_ / 2, height_ / 2);
-  coord tempCentre(srcImg.width() / 2, srcImg.height() / 2);
+// Device orientation is applied in the following order: rotate
+// counter-clockwise by keyRotation, then mirror if keyFlipH, then flip if
+// keyFlipV.
+void Image::useDeviceOrientation(device_settings_t *settings) {
+  imageFormat = settings->imageFormat;
+  nativeRotation = settings->keyRotation;
+  nativeFlipH = settings->keyFlipH;
+  nativeFlipV = settings->keyFlipV;
+}
 
-  if (srcImg.width() > width_ || srcImg.height() > height_) {
-    // Determine scale factor; the blit function maintains aspect ratio
+// Maps a pixel of the image as the device expects it back to our framebuffer,
+// undoing the flips first and then the rotation.
+int32_t Image::nativeToFrameBufferIndex(int x, int y) {
+  if (nativeFlipH)
+    x = nativeWidth() - 1 - x;
+  if (nativeFlipV)
+    y = nativeHeight() - 1 - y;
+
+  int srcX, srcY;
+  switch (nativeRotation) {
+  case ROTATE_90_DEGREES:
+    srcX = width_ - 1 - y;
+    srcY = x;
+    break;
+  case ROTATE_180_DEGREES:
+    srcX = width_ - 1 - x;
+    srcY = height_ - 1 - y;
+    break;
+  case ROTATE_270_DEGREES:
+    srcX = y;
+    srcY = height_ - 1 - x;
+    break;
+  default:
+    srcX = x;
+    srcY = y;
+    break;
+  }
+  return srcY * width_ + srcX;
+}
 
-    float scaleFactor = srcImg.width() > srcImg.height()
-                            ? (float)width_ / (float)srcImg.width()
-                            : (float)height_ / (float)srcImg.height();
+uint32_t Image::bmpLength() {
+  return bmpFileLength(nativeWidth(), nativeHeight());
+}
 
-    im.blitScaledRotated(srcImg, tempCentre, thisCentre, scaleFactor,
-                          autoRotation);
+size_t Image::exportBmp(uint8_t *outBuffer, uint32_t offset,
+                        uint32_t outLength) {
+  const int width = nativeWidth(), height = nativeHeight();
+  const uint32_t fileLength = bmpFileLength(width, height);
+  if (offset >= fileLength)
+    return 0;
+
+  const uint32_t end = offset + min(outLength, fileLength - offset);
+  uint8_t *out = outBuffer;
+  uint32_t pos = offset;
+
+  if (pos < BMP_HEADER_LENGTH) {
+    uint8_t header[BMP_HEADER_LENGTH];
+    fillBmpHeader(header, width, height);
+    const uint32_t count = min(end, (uint32_t)BMP_HEADER_LENGTH) - pos;
+    memcpy(out, header + pos, count);
+    out += count;
+    pos += count;
+  }
 
-    // If the image is the same size or smaller, just blit it into place,
-    // centred.
-  } else {
-    // Use the scaled rotated blit due to autorotation, but fix scale at 1.0
-    im.blitScaledRotated(srcImg, tempCentre, thisCentre, 1.0, autoRotation);
+  // Orientation is a fixed affine map, so walk the framebuffer by strides
+  // rather than mapping each pixel.
+  const int32_t origin = nativeToFrameBufferIndex(0, 0);
+  const int32_t stepX = nativeToFrameBufferIndex(1, 0) - origin;
+  const int32_t stepY = nativeToFrameBufferIndex(0, 1) - origin;
+  const uint32_t rowLength = bmpRowLength(width);
+  const uint32_t pixelBytes = (uint32_t)width * 3;
+
+  while (pos < end) {
+    const uint32_t fileRow = (pos - BMP_HEADER_LENGTH) / rowLength;
+    uint32_t col = (pos - BMP_HEADER_LENGTH) % rowLength;
+    const uint32_t rowEnd = min(rowLength, col + (end - pos));
+    pos += rowEnd - col;
+
+    // BMP rows are stored bottom-up.
+    const RGB565 *src = frameBuffer_ + origin +
+                        (int32_t)(height - 1 - fileRow) * stepY +
+                        (int32_t)(col / 3) * stepX;
+    uint8_t channel = col % 3;
+
+    // Expand 565 to 888 with bit replication, written as B, G, R.
+    for (; col < rowEnd && col < pixelBytes; col++) {
+      const uint16_t pixel = src->val;
+      if (channel == 0) {
+        const uint8_t b = pixel & 0x1f;
+        *out++ = (b << 3) | (b >> 2);
+        channel = 1;
+      } else if (channel == 1) {
+        const uint8_t g = (pixel >> 5) & 0x3f;
+        *out++ = (g << 2) | (g >> 4);
+        channel = 2;
+      } else {
+        const uint8_t r = pixel >> 11;
+        *out++ = (r << 3) | (r >> 2);
+        channel = 0;
+        src += stepX;
+      }
+    }
+    // Row padding
+    for (; col < rowEnd; col++) {
+      *out++ = 0;
+    }
   }
+
+  return out - outBuffer;
 }
 
 #if STREAMDECK_IMAGE_HELPER_USE_SD
@@ -119,105 +407,77 @@ void Image::blitWithScalingAndAutorotation(tgx::Image<tgx::RGB565> srcImg) {
 // has been set up correctly.
 
 bool Image::importJpeg(File file) {
-  if (!jpgDecoder.open(file, TGX_JPEGDraw))
+  JPEGDEC *decoder = acquireJpegDecoder();
+  if (!decoder)
     return false;
-
-  // Create temporary framebuffer to hold the image until we downscale and blit
-  // it into our main framebuffer
-  int tempWidth = jpgDecoder.getWidth(), tempHeight = jpgDecoder.getHeight();
-  RGB565 *tempFb = (RGB565 *)malloc(tempWidth * tempHeight * sizeof(RGB565));
-  tgx::Image<tgx::RGB565> tempImg(tempFb, tempWidth, tempHeight);
-
-  // Use tgx shortcuts for JPEGDEC to process the data into our framebuffer
-  uint8_t result = tempImg.JPEGDecode(jpgDecoder, coord(0, 0));
-  jpgDecoder.close();
-
-  if (!result) {
-    // If it fails, make sure we free the malloc
-    free(tempFb);
+  if (!decoder->open(file, jpegDrawMapped)) {
+    releaseJpegDecoder(decoder);
     return false;
   }
+  return decodeJpeg(decoder);
+}
+
+// PNGdec reads files through callbacks rather than taking a File. The handle
+// is the caller's File, which importPng leaves open.
+static File *pngOpenFile = nullptr;
 
-  blitWithScalingAndAutorotation(tempImg);
+static void *pngFileOpen(const char *filename, int32_t *size) {
+  *size = pngOpenFile->size();
+  return pngOpenFile;
+}
 
-  // Having blitted, we can now remove the temp framebuffer.
-  free(tempFb);
+static void pngFileClose(void *handle) {}
 
-  return true;
+static int32_t pngFileRead(PNGFILE *handle, uint8_t *buffer, int32_t length) {
+  return ((File *)handle->fHandle)->read(buffer, length);
 }
 
-bool Image::importJpeg(const char *filePath) {
-  if (!SD.exists(filePath))
-    return false;
+static int32_t pngFileSeek(PNGFILE *handle, int32_t position) {
+  return ((File *)handle->fHandle)->seek(position) ? position : -1;
+}
 
-  File file = SD.open(filePath);
-  if (!jpgDecoder.open(file, TGX_JPEGDraw)) {
-    file.close();
+bool Image::importPng(File file, const RGB565 background) {
+  PNG *decoder = file ? acquirePngDecoder() : nullptr;
+  if (!decoder)
+    return false;
+  pngOpenFile = &file;
+  const int opened = decoder->open(file.name(), pngFileOpen, pngFileClose,
+                                   pngFileRead, pngFileSeek, pngDrawMapped);
+  pngOpenFile = nullptr;
+  if (opened != PNG_SUCCESS) {
+    releasePngDecoder(decoder);
     return false;
   }
+  return decodePng(decoder, background);
+}
 
-  // Create temporary framebuffer to hold the image until we downscale and blit
-  // it into our main framebuffer
-  int tempWidth = jpgDecoder.getWidth(), tempHeight = jpgDecoder.getHeight();
-  RGB565 *tempFb = (RGB565 *)malloc(tempWidth * tempHeight * sizeof(RGB565));
-  tgx::Image<tgx::RGB565> tempImg(tempFb, tempWidth, tempHeight);
+bool Image::importPng(const char *filePath, const RGB565 background) {
+  if (!SD.exists(filePath))
+    return false;
 
-  // Use tgx shortcuts for JPEGDEC to process the data into our framebuffer
-  uint8_t result = tempImg.JPEGDecode(jpgDecoder, coord(0, 0));
-  jpgDecoder.close();
+  File file = SD.open(filePath);
+  const bool result = importPng(file, background);
   file.close();
+  return result;
+}
 
-  if (!result) {
-    // If it fails, make sure we free the malloc
-    free(tempFb);
+bool Image::importJpeg(const char *filePath) {
+  if (!SD.exists(filePath))
     return false;
-  }
 
-  blitWithScalingAndAutorotation(tempImg);
-
-  // Having blitted, we can now remove the temp framebuffer.
-  free(tempFb);
-
-  return true;
+  File file = SD.open(filePath);
+  const bool result = importJpeg(file);
+  file.close();
+  return result;
 }
 
-bool Image::importJpegRandom(const char *directory) {
-  if (!SD.exists(directory))
-    return false;
-
-  File dir = SD.open(directory);
-  if (!dir.isDirectory()) {
-    dir.close();
+// The directory is indexed on first use, and again whenever a different one
+// is asked for or a rescan is requested.
+bool Image::importJpegRandom(const char *directory, const bool rescan) {
+  static ImageDirectory index;
+  if ((rescan || strcmp(index.getPath(), directory)) && !index.open(directory))
     return false;
-  }
-
-  // Iterate through files to get a total count
-  uint16_t fileCount = 0;
-  while (File fh = dir.openNextFile()) {
-    if (!fh.isDirectory()) {
-      fileCount++;
-    }
-  }
-
-  // Pick a file number and start over
-  uint16_t randPick = Entropy.random(fileCount);
-  dir.rewindDirectory();
-
-  // Select our random file handle for use below
-  File fh;
-  while (fh = dir.openNextFile()) {
-    if (!fh.isDirectory()) {
-      if (randPick == 0) {
-        break;
-      }
-      randPick--;
-    }
-  }
-  importJpeg(fh);
-
-  fh.close();
-  dir.close();
-  return true;
+  return index.importRandom(this);
 }
 #endif // STREAMDECK_IMAGE_HELPER_USE_SD
 
@@ -229,21 +489,53 @@ bool Image::importJpegRandom(uint8_t *arrayOfJpgs[], uint16_t sizes[],
   return importJpeg(element, size);
 }
 
+// Image source that renders BMP pages straight into the outbound reports.
+static void bmpImageSource(uint8_t *dst, const uint32_t offset,
+                           const uint16_t length, void *context) {
+  ((Image *)context)->exportBmp(dst, offset, length);
+}
+
 bool Image::sendToKey(StreamdeckController *sdc, uint16_t keyIndex) {
+  if (imageFormat == IMAGE_FORMAT_BITMAP) {
+    sdc->setKeyImage(keyIndex, bmpLength(), bmpImageSource, this);
+    return true;
+  }
+
   // Allocate
-  uint8_t *tempJpgBuffer =
-      (uint8_t *)calloc(STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE, 1);
+  uint8_t *tempJpgBuffer = acquireOutBuffer();
+  if (!tempJpgBuffer)
+    return false;
+  size_t jpgSize =
+      exportJpeg(tempJpgBuffer, STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE);
+  if (jpgSize)
+    sdc->setKeyImage(keyIndex, tempJpgBuffer, jpgSize);
+  releaseOutBuffer(tempJpgBuffer);
+  return jpgSize > 0;
+}
+
+image_queue_result_t Image::trySendToKey(StreamdeckController *sdc,
+                                         uint16_t keyIndex) {
+  if (imageFormat == IMAGE_FORMAT_BITMAP)
+    return sdc->trySetKeyImage(keyIndex, bmpLength(), bmpImageSource, this);
+
+  uint8_t *tempJpgBuffer = acquireOutBuffer();
+  if (!tempJpgBuffer)
+    return IMAGE_NO_TARGET;
   size_t jpgSize =
       exportJpeg(tempJpgBuffer, STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE);
-  sdc->setKeyImage(keyIndex, tempJpgBuffer, jpgSize);
-  free(tempJpgBuffer);
-  return true;
+  const image_queue_result_t result =
+      jpgSize ? sdc->trySetKeyImage(keyIndex, tempJpgBuffer, jpgSize)
+              : IMAGE_NO_TARGET;
+  releaseOutBuffer(tempJpgBuffer);
+  return result;
 }
 
 void Image::transform(float scaleFactor, float rotationDegrees,
                       RGB565 backgroundColour) {
   // Allocate same-sized framebuffer for temporary holding of the image
-  RGB565 *tempFb = (RGB565 *)malloc(width_ * height_ * sizeof(RGB565));
+  RGB565 *tempFb = acquireScratchFrameBuffer((uint32_t)width_ * height_);
+  if (!tempFb)
+    return;
   tgx::Image<tgx::RGB565> tempImg(tempFb, width_, height_);
 
   tempImg.copyFrom(im);
@@ -254,7 +546,7 @@ void Image::transform(float scaleFactor, float rotationDegrees,
   im.clear(backgroundColour);
   im.blitScaledRotated(tempImg, half, half, scaleFactor, rotationDegrees);
 
-  free(tempFb);
+  releaseScratchFrameBuffer(tempFb);
 }
 
 } // namespace Streamdeck
@@ -28,13 +28,12 @@ Credit to:
 #include "../device_specifics.hpp"
 #include "../../streamdeck_config.hpp"
 #include "../usbhost_driver/streamdeck_usb.hpp"
+#include "streamdeck_mapping.hpp"
+#include "streamdeck_memory.hpp"
 #include <Arduino.h>
 
 #if STREAMDECK_IMAGE_HELPER_ENABLE
 
-#include <JPEGDEC.h>
-#include <JPEGENC.h>
-#include <PNGdec.h>
 #include <tgx.h>
 
 #if STREAMDECK_IMAGE_HELPER_USE_SD
@@ -55,9 +54,7 @@ public:
     im = tgx::Image<tgx::RGB565>(frameBuffer_, width_, height_);
   };
   Image(device_settings_t *settings) {
-    autoRotation = (float)settings->keyRotation * 90.0f;
-    autoFlipH = settings->keyFlipH;
-    autoFlipV = settings->keyFlipV;
+    useDeviceOrientation(settings);
     width_ = settings->keyWidth;
     height_ = settings->keyHeight;
     allocateFrameBuffer(width_, height_);
@@ -70,9 +67,7 @@ public:
     im = tgx::Image<tgx::RGB565>(frameBuffer_, width_, height_);
   }
   Image(RGB565 *frameBuffer, device_settings_t *settings) {
-    autoRotation = (float)settings->keyRotation * 90.0f;
-    autoFlipH = settings->keyFlipH;
-    autoFlipV = settings->keyFlipV;
+    useDeviceOrientation(settings);
     width_ = settings->keyWidth;
     height_ = settings->keyHeight;
     frameBuffer_ = frameBuffer;
@@ -80,24 +75,45 @@ public:
   }
   ~Image() { freeFrameBuffer(); }
 
+  // Points the image at another caller-owned framebuffer, sized and oriented
+  // for the settings' keys. Lets one Image encode many keys' pixels in turn.
+  void setFrameBuffer(RGB565 *frameBuffer, device_settings_t *settings);
+
   // Import
   bool importJpeg(const uint8_t *inBuffer, const uint16_t inLength);
   bool importJpegRandom(uint8_t *arrayOfJpgs[], uint16_t sizes[],
                         size_t jpgCount);
-  // bool importPng(const uint8_t* buffer, const uint16_t bufferLen);
+  // PNGs are fitted and centred like JPEGs, with transparency blended over
+  // background.
+  bool importPng(const uint8_t *buffer, const uint16_t bufferLen,
+                 RGB565 background = tgx::RGB565_Black);
 #if STREAMDECK_IMAGE_HELPER_USE_SD
   bool importJpeg(File file);
   bool importJpeg(const char *filePath);
-  bool importJpegRandom(const char *directory);
-  // bool importPng(File file);
-  // bool importPng(const char* path);
+  // Picks from an index of the directory, built on the first call for it.
+  // Pass rescan to index it again after files were added; a pick that was
+  // removed triggers that by itself.
+  bool importJpegRandom(const char *directory, const bool rescan = false);
+  bool importPng(File file, RGB565 background = tgx::RGB565_Black);
+  bool importPng(const char *filePath, RGB565 background = tgx::RGB565_Black);
 #endif // STREAMDECK_IMAGE_HELPER_USE_SD
 
-  // Export
+  // Export, in the device's orientation
   size_t exportJpeg(uint8_t *outBuffer, uint16_t outLength);
+  // Writes bytes [offset, offset + outLength) of the image as a 24-bit BMP
+  // file. Returns the number of bytes written.
+  size_t exportBmp(uint8_t *outBuffer, uint32_t offset, uint32_t outLength);
+  size_t exportBmp(uint8_t *outBuffer, uint32_t outLength) {
+    return exportBmp(outBuffer, 0, outLength);
+  }
+  uint32_t bmpLength();
 
   // USB Shortcuts
   bool sendToKey(StreamdeckController *sdc, uint16_t keyIndex);
+  // Without waiting for the report ring (see trySetKeyImage). An image that
+  // can't be encoded is reported as IMAGE_NO_TARGET.
+  image_queue_result_t trySendToKey(StreamdeckController *sdc,
+                                    uint16_t keyIndex);
 
   // Graphical manipulations
   tgx::Image<tgx::RGB565>* getTGXImage() { return &im; };
@@ -108,23 +124,38 @@ public:
 private:
   tgx::Image<tgx::RGB565> im;
 
-  JPEGENC jpgEncoder;
-  JPEGDEC jpgDecoder;
-  PNG pngDecoder;
-
   void allocateFrameBuffer(const uint16_t width, const uint16_t height);
   void freeFrameBuffer();
 
-  // Graphical shortcuts
-  void blitWithScalingAndAutorotation(tgx::Image<tgx::RGB565> srcImg);
+  // How far (as a power of 2) importJpeg shrinks a source of this size while
+  // decoding, before scaling the rest of the way to fit.
+  uint8_t decodeScaleShift(const int srcWidth, const int srcHeight);
+
+  // Codecs are borrowed from the shared pool in streamdeck_memory.hpp for
+  // the length of each import or export.
+  bool decodeJpeg(JPEGDEC *decoder);
+  bool decodePng(PNG *decoder, const RGB565 background);
+#if STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS
+  bool useExifThumbnail(JPEGDEC *decoder, const int width, const int height);
+#endif // STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS
+
+  // Device orientation
+  void useDeviceOrientation(device_settings_t *settings);
+  int32_t nativeToFrameBufferIndex(int x, int y);
+  int nativeWidth() { return nativeRotation & 1 ? height_ : width_; }
+  int nativeHeight() { return nativeRotation & 1 ? width_ : height_; }
 
   RGB565 *frameBuffer_ = nullptr;
   bool madeFrameBuffer = false;
   int width_ = 0;
   int height_ = 0;
-  float autoRotation = 0.0f;
-  bool autoFlipH = false;
-  bool autoFlipV = false;
+
+  // The framebuffer is kept upright; the device's orientation is applied while
+  // exporting.
+  image_format_t imageFormat = IMAGE_FORMAT_JPEG;
+  key_rotation_t nativeRotation = ROTATE_NONE;
+  bool nativeFlipH = false;
+  bool nativeFlipV = false;
 };
 
 } // namespace Streamdeck
@@ -0,0 +1,671 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#include "streamdeck_jpeg_transform.hpp"
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+#include "streamdeck_memory.hpp"
+
+namespace Streamdeck {
+
+// Natural (row-major) position of each zigzag index.
+static const uint8_t jpegZigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// Standard Huffman tables (ITU T.81 Annex K.3): code counts per length,
+// followed by the symbols.
+static const uint8_t stdDcLuminance[16 + 12] = {
+    0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t stdDcChrominance[16 + 12] = {
+    0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t stdAcLuminance[16 + 162] = {
+    0,    2,    1,    3,    3,    2,    4,    3,    5,    5,    4,    4,
+    0,    0,    1,    0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+    0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32,
+    0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a,
+    0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55,
+    0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85,
+    0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2,
+    0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8,
+    0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+static const uint8_t stdAcChrominance[16 + 162] = {
+    0,    2,    1,    2,    4,    4,    3,    4,    7,    5,    4,    4,
+    0,    1,    2,    0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+    0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81,
+    0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17,
+    0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54,
+    0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83,
+    0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9,
+    0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+    0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+    0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+static const uint8_t JPEG_MAX_COMPONENTS = 3;
+
+struct jpeg_component_t {
+  uint8_t id;
+  uint8_t h; // Sampling factors
+  uint8_t v;
+  uint8_t tq; // Quantisation table
+  uint8_t td; // DC and AC Huffman tables of the input
+  uint8_t ta;
+  uint16_t blocksW; // Block grid of the input
+  uint16_t blocksH;
+  uint16_t keptW; // The part of it that is transformed
+  uint16_t keptH;
+  uint32_t base; // First entry in the block index
+  int16_t dc;    // DC predictor
+};
+
+struct jpeg_huffman_decoder_t {
+  bool present;
+  int32_t maxCode[17]; // Largest code of each length, -1 if none
+  int32_t minCode[17];
+  uint8_t valPtr[17];
+  uint8_t vals[256];
+};
+
+struct jpeg_huffman_encoder_t {
+  uint16_t code[256];
+  uint8_t size[256];
+};
+
+// Where each block's entropy-coded data starts in the input scan, as
+// (byte << 3) | bit, and its absolute DC coefficient. Blocks are re-read from
+// here in output order, so the coefficients never need to be held at once.
+struct jpeg_block_t {
+  uint32_t position;
+  int16_t dc;
+};
+
+struct jpeg_bit_reader_t {
+  const uint8_t *data;
+  uint32_t length;
+  uint32_t pos;
+  uint8_t bit;
+  bool error;
+};
+
+struct jpeg_bit_writer_t {
+  uint8_t *data;
+  uint32_t length;
+  uint32_t pos;
+  uint32_t acc;
+  uint8_t count;
+  bool error;
+};
+
+static inline uint16_t readBE16(const uint8_t *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void buildDecoder(jpeg_huffman_decoder_t &table, const uint8_t *counts,
+                         const uint8_t *vals, const uint16_t valCount) {
+  int32_t code = 0;
+  uint16_t index = 0;
+  for (uint8_t length = 1; length <= 16; length++) {
+    const uint8_t count = counts[length - 1];
+    table.valPtr[length] = (uint8_t)index;
+    table.minCode[length] = code;
+    code += count;
+    index += count;
+    table.maxCode[length] = count ? code - 1 : -1;
+    code <<= 1;
+  }
+  memcpy(table.vals, vals, min(valCount, (uint16_t)256));
+  table.present = true;
+}
+
+static void buildEncoder(jpeg_huffman_encoder_t &table, const uint8_t *spec) {
+  memset(table.size, 0, sizeof(table.size));
+  const uint8_t *vals = spec + 16;
+  uint16_t code = 0;
+  for (uint8_t length = 1; length <= 16; length++) {
+    for (uint8_t i = 0; i < spec[length - 1]; i++) {
+      table.code[*vals] = code++;
+      table.size[*vals++] = length;
+    }
+    code <<= 1;
+  }
+}
+
+static inline uint8_t readBit(jpeg_bit_reader_t &reader) {
+  if (reader.pos >= reader.length) {
+    reader.error = true;
+    return 0;
+  }
+  const uint8_t byte = reader.data[reader.pos];
+  const uint8_t bit = (byte >> (7 - reader.bit)) & 1;
+  if (++reader.bit == 8) {
+    reader.bit = 0;
+    // Skip the stuffed zero after an 0xff data byte.
+    reader.pos += byte == 0xff ? 2 : 1;
+  }
+  return bit;
+}
+
+static inline int32_t readBits(jpeg_bit_reader_t &reader, const uint8_t count) {
+  int32_t value = 0;
+  for (uint8_t i = 0; i < count; i++)
+    value = (value << 1) | readBit(reader);
+  return value;
+}
+
+static uint8_t decodeSymbol(jpeg_bit_reader_t &reader,
+                            const jpeg_huffman_decoder_t &table) {
+  int32_t code = 0;
+  for (uint8_t length = 1; length <= 16; length++) {
+    code = (code << 1) | readBit(reader);
+    if (code <= table.maxCode[length])
+      return table.vals[table.valPtr[length] + code - table.minCode[length]];
+  }
+  reader.error = true;
+  return 0;
+}
+
+// Sign-extends a category-coded value (T.81 F.2.2.1).
+static inline int16_t extend(const int32_t value, const uint8_t category) {
+  return (int16_t)(value < (1 << (category - 1))
+                       ? value - (1 << category) + 1
+                       : value);
+}
+
+// Decodes one block into coefficients in zigzag order. Returns the DC
+// difference; coefficients[0] is left to the caller.
+static int16_t decodeBlock(jpeg_bit_reader_t &reader,
+                           const jpeg_huffman_decoder_t &dcTable,
+                           const jpeg_huffman_decoder_t &acTable,
+                           int16_t *coefficients) {
+  const uint8_t dcCategory = decodeSymbol(reader, dcTable);
+  if (dcCategory > 11) {
+    reader.error = true;
+    return 0;
+  }
+  const int16_t diff =
+      dcCategory ? extend(readBits(reader, dcCategory), dcCategory) : 0;
+
+  if (coefficients)
+    memset(coefficients, 0, 64 * sizeof(int16_t));
+  for (uint8_t k = 1; k < 64 && !reader.error; k++) {
+    const uint8_t symbol = decodeSymbol(reader, acTable);
+    const uint8_t run = symbol >> 4, category = symbol & 0x0f;
+    if (!category) {
+      if (run != 15)
+        break; // End of block
+      k += 15;
+      continue;
+    }
+    k += run;
+    if (k > 63 || category > 10) {
+      reader.error = true;
+      break;
+    }
+    const int16_t value = extend(readBits(reader, category), category);
+    if (coefficients)
+      coefficients[k] = value;
+  }
+  return diff;
+}
+
+static inline void writeByte(jpeg_bit_writer_t &writer, const uint8_t byte) {
+  if (writer.pos >= writer.length) {
+    writer.error = true;
+    return;
+  }
+  writer.data[writer.pos++] = byte;
+}
+
+static void writeBits(jpeg_bit_writer_t &writer, const uint32_t bits,
+                      const uint8_t count) {
+  writer.acc = (writer.acc << count) | (bits & ((1UL << count) - 1));
+  writer.count += count;
+  while (writer.count >= 8) {
+    const uint8_t byte = (uint8_t)(writer.acc >> (writer.count - 8));
+    writeByte(writer, byte);
+    if (byte == 0xff)
+      writeByte(writer, 0x00);
+    writer.count -= 8;
+  }
+  writer.acc &= (1UL << writer.count) - 1;
+}
+
+static inline uint8_t category(int16_t value) {
+  uint16_t magnitude = value < 0 ? -value : value;
+  uint8_t bits = 0;
+  while (magnitude) {
+    bits++;
+    magnitude >>= 1;
+  }
+  return bits;
+}
+
+static void encodeBlock(jpeg_bit_writer_t &writer,
+                        const jpeg_huffman_encoder_t &dcTable,
+                        const jpeg_huffman_encoder_t &acTable,
+                        const int16_t diff, const int16_t *coefficients) {
+  uint8_t bits = category(diff);
+  writeBits(writer, dcTable.code[bits], dcTable.size[bits]);
+  if (bits)
+    writeBits(writer, diff < 0 ? diff - 1 : diff, bits);
+
+  uint8_t run = 0;
+  for (uint8_t k = 1; k < 64; k++) {
+    const int16_t value = coefficients[k];
+    if (!value) {
+      run++;
+      continue;
+    }
+    for (; run > 15; run -= 16)
+      writeBits(writer, acTable.code[0xf0], acTable.size[0xf0]);
+    bits = category(value);
+    const uint8_t symbol = (run << 4) | bits;
+    writeBits(writer, acTable.code[symbol], acTable.size[symbol]);
+    writeBits(writer, value < 0 ? value - 1 : value, bits);
+    run = 0;
+  }
+  if (run)
+    writeBits(writer, acTable.code[0x00], acTable.size[0x00]);
+}
+
+static void writeMarker(jpeg_bit_writer_t &writer, const uint8_t marker,
+                        const uint16_t length) {
+  writeByte(writer, 0xff);
+  writeByte(writer, marker);
+  if (length) {
+    writeByte(writer, length >> 8);
+    writeByte(writer, length & 0xff);
+  }
+}
+
+static void writeHuffmanTable(jpeg_bit_writer_t &writer, const uint8_t id,
+                              const uint8_t *spec, const uint16_t valCount) {
+  writeMarker(writer, 0xc4, 2 + 1 + 16 + valCount);
+  writeByte(writer, id);
+  for (uint16_t i = 0; i < 16 + valCount; i++)
+    writeByte(writer, spec[i]);
+}
+
+size_t transformJpeg(const uint8_t *in, const uint32_t inLength, uint8_t *out,
+                     const uint32_t outLength, const key_rotation_t rotation,
+                     const bool flipH, const bool flipV) {
+  // Whole-image transform as: transpose, then mirror, then flip.
+  bool transpose = false, mirror = false, flip = false;
+  switch (rotation) {
+  case ROTATE_90_DEGREES:
+    transpose = true;
+    flip = true;
+    break;
+  case ROTATE_180_DEGREES:
+    mirror = true;
+    flip = true;
+    break;
+  case ROTATE_270_DEGREES:
+    transpose = true;
+    mirror = true;
+    break;
+  default:
+    break;
+  }
+  mirror ^= flipH;
+  flip ^= flipV;
+
+  // Parse the headers up to the start of the scan.
+  if (inLength < 4 || in[0] != 0xff || in[1] != 0xd8)
+    return 0;
+
+  jpeg_component_t components[JPEG_MAX_COMPONENTS];
+  uint8_t componentCount = 0;
+  uint16_t width = 0, height = 0;
+  const uint8_t *quantTables[4] = {};
+  // DC tables 0-3, then AC tables 0-3. Kept off the stack.
+  static jpeg_huffman_decoder_t decoders[8];
+  for (uint8_t i = 0; i < 8; i++)
+    decoders[i].present = false;
+
+  uint32_t pos = 2;
+  uint32_t scanStart = 0;
+  while (!scanStart) {
+    // Markers may be preceded by fill bytes.
+    while (pos < inLength && in[pos] == 0xff)
+      pos++;
+    if (pos + 2 >= inLength)
+      return 0;
+    const uint8_t marker = in[pos++];
+    const uint16_t length = readBE16(in + pos);
+    if (length < 2 || pos + length > inLength)
+      return 0;
+    const uint8_t *segment = in + pos + 2;
+    const uint16_t segmentLength = length - 2;
+
+    switch (marker) {
+    case 0xc0: // Baseline
+    case 0xc1: // Extended sequential, Huffman coded
+      if (segmentLength < 6 || segment[0] != 8)
+        return 0;
+      height = readBE16(segment + 1);
+      width = readBE16(segment + 3);
+      componentCount = segment[5];
+      if (!componentCount || componentCount > JPEG_MAX_COMPONENTS ||
+          segmentLength < 6 + 3 * componentCount)
+        return 0;
+      for (uint8_t i = 0; i < componentCount; i++) {
+        const uint8_t *spec = segment + 6 + 3 * i;
+        components[i].id = spec[0];
+        components[i].h = spec[1] >> 4;
+        components[i].v = spec[1] & 0x0f;
+        components[i].tq = spec[2] & 0x03;
+        if (!components[i].h || !components[i].v)
+          return 0;
+      }
+      break;
+
+    case 0xc4: { // Huffman tables
+      uint16_t offset = 0;
+      while (offset + 17 <= segmentLength) {
+        const uint8_t tableClass = segment[offset] >> 4;
+        const uint8_t id = segment[offset] & 0x03;
+        uint16_t valCount = 0;
+        for (uint8_t i = 0; i < 16; i++)
+          valCount += segment[offset + 1 + i];
+        if (tableClass > 1 || valCount > 256 ||
+            offset + 17 + valCount > segmentLength)
+          return 0;
+        buildDecoder(decoders[tableClass * 4 + id], segment + offset + 1,
+                     segment + offset + 17, valCount);
+        offset += 17 + valCount;
+      }
+      break;
+    }
+
+    case 0xdb: { // Quantisation tables; copied into the output as they are
+      // The output is baseline, which only allows 8-bit tables.
+      uint16_t offset = 0;
+      while (offset < segmentLength) {
+        const uint16_t tableLength = 1 + 64;
+        if (segment[offset] >> 4 || offset + tableLength > segmentLength)
+          return 0;
+        quantTables[segment[offset] & 0x03] = segment + offset;
+        offset += tableLength;
+      }
+      break;
+    }
+
+    case 0xdd: // Restart interval
+      if (segmentLength < 2 || readBE16(segment))
+        return 0;
+      break;
+
+    case 0xda: { // Start of scan; all components, interleaved, in one scan
+      if (!componentCount || segmentLength < 1 ||
+          segment[0] != componentCount ||
+          segmentLength < 1 + 2 * componentCount + 3)
+        return 0;
+      for (uint8_t i = 0; i < componentCount; i++) {
+        const uint8_t *spec = segment + 1 + 2 * i;
+        if (spec[0] != components[i].id)
+          return 0;
+        components[i].td = spec[1] >> 4;
+        components[i].ta = spec[1] & 0x0f;
+        if (components[i].td > 3 || components[i].ta > 3 ||
+            !decoders[components[i].td].present ||
+            !decoders[4 + components[i].ta].present ||
+            !quantTables[components[i].tq])
+          return 0;
+      }
+      const uint8_t *spectral = segment + 1 + 2 * componentCount;
+      if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0)
+        return 0;
+      scanStart = pos + length;
+      break;
+    }
+
+    default:
+      // Progressive, lossless and arithmetic coded frames can't be handled;
+      // anything else (APPn, COM) is dropped.
+      if ((marker >= 0xc2 && marker <= 0xcf) || marker == 0xd9)
+        return 0;
+      break;
+    }
+    pos += length;
+  }
+
+  if (!width || !height)
+    return 0;
+
+  // A single component is coded block by block whatever its sampling factors.
+  if (componentCount == 1)
+    components[0].h = components[0].v = 1;
+
+  uint8_t maxH = 1, maxV = 1;
+  for (uint8_t i = 0; i < componentCount; i++) {
+    maxH = max(maxH, components[i].h);
+    maxV = max(maxV, components[i].v);
+  }
+  const uint16_t mcuWidth = 8 * maxH, mcuHeight = 8 * maxV;
+  const uint16_t mcusX = (width + mcuWidth - 1) / mcuWidth;
+  const uint16_t mcusY = (height + mcuHeight - 1) / mcuHeight;
+
+  // A partial MCU on an edge the transform moves to the top or left would
+  // bring its padding into the image. Like jpegtran -trim, drop such a
+  // partial row or column, so the output is that much smaller.
+  if (transpose ? flip : mirror)
+    width -= width % mcuWidth;
+  if (transpose ? mirror : flip)
+    height -= height % mcuHeight;
+  if (!width || !height)
+    return 0;
+  const uint16_t keptMcusX = (width + mcuWidth - 1) / mcuWidth;
+  const uint16_t keptMcusY = (height + mcuHeight - 1) / mcuHeight;
+
+  uint32_t blockCount = 0;
+  for (uint8_t i = 0; i < componentCount; i++) {
+    components[i].blocksW = mcusX * components[i].h;
+    components[i].blocksH = mcusY * components[i].v;
+    components[i].keptW = keptMcusX * components[i].h;
+    components[i].keptH = keptMcusY * components[i].v;
+    components[i].base = blockCount;
+    components[i].dc = 0;
+    blockCount += (uint32_t)components[i].blocksW * components[i].blocksH;
+  }
+
+  jpeg_block_t *blocks =
+      (jpeg_block_t *)acquireScratch(blockCount * sizeof(jpeg_block_t));
+  if (!blocks)
+    return 0;
+
+  // Index pass: note where every block starts and its absolute DC.
+  jpeg_bit_reader_t reader = {in, inLength, scanStart, 0, false};
+  for (uint16_t mcuY = 0; mcuY < mcusY && !reader.error; mcuY++) {
+    for (uint16_t mcuX = 0; mcuX < mcusX && !reader.error; mcuX++) {
+      for (uint8_t c = 0; c < componentCount; c++) {
+        jpeg_component_t &comp = components[c];
+        for (uint8_t by = 0; by < comp.v; by++) {
+          for (uint8_t bx = 0; bx < comp.h; bx++) {
+            jpeg_block_t &block =
+                blocks[comp.base +
+                       (uint32_t)(mcuY * comp.v + by) * comp.blocksW +
+                       mcuX * comp.h + bx];
+            block.position = (reader.pos << 3) | reader.bit;
+            comp.dc += decodeBlock(reader, decoders[comp.td],
+                                   decoders[4 + comp.ta], nullptr);
+            block.dc = comp.dc;
+          }
+        }
+      }
+    }
+  }
+  if (reader.error) {
+    releaseScratch(blocks);
+    return 0;
+  }
+
+  // Where each output coefficient comes from, in zigzag order, and its sign.
+  int8_t sourceIndex[64];
+  int8_t sign[64];
+  {
+    uint8_t inverseZigzag[64];
+    for (uint8_t k = 0; k < 64; k++)
+      inverseZigzag[jpegZigzag[k]] = k;
+    for (uint8_t k = 0; k < 64; k++) {
+      const uint8_t row = jpegZigzag[k] >> 3, col = jpegZigzag[k] & 7;
+      sourceIndex[k] = inverseZigzag[transpose ? col * 8 + row : row * 8 + col];
+      sign[k] = ((mirror && (col & 1)) != (flip && (row & 1))) ? -1 : 1;
+    }
+  }
+
+  // Output headers. Transposed images get transposed quantisation tables and
+  // swapped dimensions and sampling factors.
+  jpeg_bit_writer_t writer = {out, outLength, 0, 0, 0, false};
+  const uint16_t outWidth = transpose ? height : width;
+  const uint16_t outHeight = transpose ? width : height;
+  writeMarker(writer, 0xd8, 0);
+
+  for (uint8_t id = 0; id < 4; id++) {
+    const uint8_t *table = quantTables[id];
+    if (!table)
+      continue;
+    writeMarker(writer, 0xdb, 2 + 1 + 64);
+    writeByte(writer, table[0]);
+    for (uint8_t k = 0; k < 64; k++)
+      writeByte(writer, table[1 + sourceIndex[k]]);
+  }
+
+  writeMarker(writer, 0xc0, 2 + 6 + 3 * componentCount);
+  writeByte(writer, 8);
+  writeByte(writer, outHeight >> 8);
+  writeByte(writer, outHeight & 0xff);
+  writeByte(writer, outWidth >> 8);
+  writeByte(writer, outWidth & 0xff);
+  writeByte(writer, componentCount);
+  for (uint8_t c = 0; c < componentCount; c++) {
+    const jpeg_component_t &comp = components[c];
+    writeByte(writer, comp.id);
+    writeByte(writer,
+              transpose ? (comp.v << 4) | comp.h : (comp.h << 4) | comp.v);
+    writeByte(writer, comp.tq);
+  }
+
+  writeHuffmanTable(writer, 0x00, stdDcLuminance, 12);
+  writeHuffmanTable(writer, 0x10, stdAcLuminance, 162);
+  if (componentCount > 1) {
+    writeHuffmanTable(writer, 0x01, stdDcChrominance, 12);
+    writeHuffmanTable(writer, 0x11, stdAcChrominance, 162);
+  }
+
+  writeMarker(writer, 0xda, 2 + 1 + 2 * componentCount + 3);
+  writeByte(writer, componentCount);
+  for (uint8_t c = 0; c < componentCount; c++) {
+    writeByte(writer, components[c].id);
+    writeByte(writer, c ? 0x11 : 0x00);
+  }
+  writeByte(writer, 0);
+  writeByte(writer, 63);
+  writeByte(writer, 0);
+
+  static jpeg_huffman_encoder_t encoders[4]; // DC and AC, luminance first
+  static bool encodersBuilt = false;
+  if (!encodersBuilt) {
+    buildEncoder(encoders[0], stdDcLuminance);
+    buildEncoder(encoders[1], stdAcLuminance);
+    buildEncoder(encoders[2], stdDcChrominance);
+    buildEncoder(encoders[3], stdAcChrominance);
+    encodersBuilt = true;
+  }
+
+  // Scan: walk the output MCUs, re-reading each source block from its index
+  // entry.
+  const uint16_t outMcusX = transpose ? keptMcusY : keptMcusX;
+  const uint16_t outMcusY = transpose ? keptMcusX : keptMcusY;
+  int16_t coefficients[64], transformed[64];
+  int16_t lastDc[JPEG_MAX_COMPONENTS] = {};
+
+  for (uint16_t mcuY = 0; mcuY < outMcusY && !reader.error; mcuY++) {
+    for (uint16_t mcuX = 0; mcuX < outMcusX && !reader.error; mcuX++) {
+      for (uint8_t c = 0; c < componentCount; c++) {
+        const jpeg_component_t &comp = components[c];
+        const uint8_t h = transpose ? comp.v : comp.h;
+        const uint8_t v = transpose ? comp.h : comp.v;
+        const uint16_t keptW = transpose ? comp.keptH : comp.keptW;
+        const uint16_t keptH = transpose ? comp.keptW : comp.keptH;
+        const jpeg_huffman_encoder_t *tables = encoders + (c ? 2 : 0);
+
+        for (uint8_t by = 0; by < v; by++) {
+          for (uint8_t bx = 0; bx < h; bx++) {
+            uint16_t x = mcuX * h + bx, y = mcuY * v + by;
+            if (mirror)
+              x = keptW - 1 - x;
+            if (flip)
+              y = keptH - 1 - y;
+            const jpeg_block_t &block =
+                blocks[comp.base + (transpose ? (uint32_t)x * comp.blocksW + y
+                                              : (uint32_t)y * comp.blocksW + x)];
+
+            reader.pos = block.position >> 3;
+            reader.bit = block.position & 7;
+            decodeBlock(reader, decoders[comp.td], decoders[4 + comp.ta],
+                        coefficients);
+            for (uint8_t k = 1; k < 64; k++)
+              transformed[k] = sign[k] * coefficients[sourceIndex[k]];
+
+            encodeBlock(writer, tables[0], tables[1], block.dc - lastDc[c],
+                        transformed);
+            lastDc[c] = block.dc;
+          }
+        }
+      }
+    }
+  }
+  releaseScratch(blocks);
+
+  // Pad the last byte with ones.
+  if (writer.count)
+    writeBits(writer, 0xff, 8 - writer.count);
+  writeMarker(writer, 0xd9, 0);
+
+  if (reader.error || writer.error)
+    return 0;
+  return writer.pos;
+}
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
@@ -0,0 +1,65 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../device_specifics.hpp"
+#include "../../streamdeck_config.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+namespace Streamdeck {
+
+// Losslessly rotates and flips a baseline JPEG by reordering its DCT blocks
+// and sign-flipping or transposing their coefficients, then entropy coding
+// them again with the standard Huffman tables. Nothing is decoded to pixels.
+// The orientation is applied like a device's: rotate counter-clockwise by
+// rotation, then mirror if flipH, then flip if flipV.
+//
+// Only single-scan, 8-bit sequential JPEGs without restart markers can be
+// transformed. A partial MCU (8 or 16 pixels, depending on chroma
+// subsampling) on an edge that ends up top or left is dropped, as jpegtran
+// -trim does, so the output is smaller: a 72x72 4:2:0 JPEG rotated 180
+// degrees comes out 64x64. Use 4:4:4 or 16-pixel multiples to keep every
+// pixel. Returns the length written to out, or 0 if the JPEG can't be
+// transformed or out is too small. Indexes the blocks in scratch memory: 8
+// Bytes per 8x8 block, so 0.375 Bytes per pixel at most.
+size_t transformJpeg(const uint8_t *in, const uint32_t inLength, uint8_t *out,
+                     const uint32_t outLength, const key_rotation_t rotation,
+                     const bool flipH, const bool flipV);
+
+// Turns an upright key image into one in the device's native orientation,
+// ready for setKeyImage.
+inline size_t orientJpegForKey(const device_settings_t *settings,
+                               const uint8_t *in, const uint32_t inLength,
+                               uint8_t *out, const uint32_t outLength) {
+  return transformJpeg(in, inLength, out, outLength, settings->keyRotation,
+                       settings->keyFlipH, settings->keyFlipV);
+}
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
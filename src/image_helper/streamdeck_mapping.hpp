@@ -0,0 +1,111 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../../streamdeck_config.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+#include <tgx.h>
+
+namespace Streamdeck {
+
+// Where decoded pixels land in a framebuffer. Destination pixel (x, y) of
+// the dstWidth x dstHeight rectangle at (dstX, dstY) samples source pixel
+// ((x * stepX + stepX / 2) >> 16, likewise for y), so the decoders' blocks and
+// lines are scaled straight into place as they arrive.
+struct source_mapping_t {
+  tgx::RGB565 *frameBuffer;
+  int stride;
+  int dstX;
+  int dstY;
+  int dstWidth;
+  int dstHeight;
+  uint32_t stepX; // Source pixels per destination pixel, 16.16 fixed point
+  uint32_t stepY;
+};
+
+inline int mappedSource(const int dst, const uint32_t step) {
+  return (int)(((uint32_t)dst * step + step / 2) >> 16);
+}
+
+// First destination pixel sampling source pixel src or beyond.
+inline int firstMappedDestination(const int src, const uint32_t step) {
+  const int64_t num = ((int64_t)src << 16) - step / 2;
+  return num <= 0 ? 0 : (int)((num + step - 1) / step);
+}
+
+// True if a srcWidth x srcHeight image is limited by width when fitted into
+// width x height.
+inline bool fitsToWidth(const int srcWidth, const int srcHeight,
+                        const int width, const int height) {
+  return (int32_t)srcWidth * height > (int32_t)srcHeight * width;
+}
+
+// JPEGDEC can shrink by 2, 4 or 8 while decoding, for almost nothing. Picks
+// the largest of those that keeps the limiting side at least as large as the
+// width x height target, so only the residual scaling is left for the draw
+// callback.
+inline uint8_t jpegScaleShift(const int srcWidth, const int srcHeight,
+                              const int width, const int height) {
+  const bool fitWidth = fitsToWidth(srcWidth, srcHeight, width, height);
+  const int src = fitWidth ? srcWidth : srcHeight;
+  const int dst = fitWidth ? width : height;
+  uint8_t shift = 0;
+  while (shift < 3 && (src >> (shift + 1)) >= dst)
+    shift++;
+  return shift;
+}
+
+// Fits a srcWidth x srcHeight source into a width x height framebuffer,
+// centred. Sources smaller than the framebuffer are centred unscaled unless
+// enlarge is set.
+inline void fitSourceMapping(source_mapping_t &map,
+                             tgx::RGB565 *frameBuffer, const int width,
+                             const int height, const int srcWidth,
+                             const int srcHeight, const bool enlarge = false) {
+  map.frameBuffer = frameBuffer;
+  map.stride = width;
+  if (!enlarge && srcWidth <= width && srcHeight <= height) {
+    map.dstWidth = srcWidth;
+    map.dstHeight = srcHeight;
+  } else if (fitsToWidth(srcWidth, srcHeight, width, height)) {
+    map.dstWidth = width;
+    map.dstHeight = max(1, (int)((int32_t)srcHeight * width / srcWidth));
+  } else {
+    map.dstWidth = max(1, (int)((int32_t)srcWidth * height / srcHeight));
+    map.dstHeight = height;
+  }
+  map.dstX = (width - map.dstWidth) / 2;
+  map.dstY = (height - map.dstHeight) / 2;
+  map.stepX = ((uint32_t)srcWidth << 16) / map.dstWidth;
+  map.stepY = ((uint32_t)srcHeight << 16) / map.dstHeight;
+}
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
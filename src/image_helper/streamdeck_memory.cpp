@@ -0,0 +1,178 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#include "streamdeck_memory.hpp"
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+namespace Streamdeck {
+
+#if STREAMDECK_IMAGE_HELPER_STATIC_MEMORY
+
+static tgx::RGB565 streamdeckKeyFrameBuffers[traitMax32(STATIC_KEY_SLOTS, 1)]
+                                            [traitMax32(MAX_KEY_PIXELS, 1)];
+static tgx::RGB565
+    streamdeckScreenFrameBuffers[traitMax32(STATIC_SCREEN_SLOTS, 1)]
+                                [traitMax32(MAX_SCREEN_PIXELS, 1)];
+static uint32_t streamdeckScratch[(STATIC_SCRATCH_BYTES + 3) / 4];
+static uint8_t streamdeckOutBuffer[STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE];
+
+static uint32_t keySlotsUsed = 0;
+static uint32_t screenSlotsUsed = 0;
+static bool scratchUsed = false;
+static bool outBufferUsed = false;
+
+// Takes the first free slot of a pool, or returns -1.
+static int8_t takeSlot(uint32_t &used, const uint32_t slots) {
+  for (uint8_t i = 0; i < slots; i++) {
+    if (!(used & (1UL << i))) {
+      used |= 1UL << i;
+      return i;
+    }
+  }
+  return -1;
+}
+
+tgx::RGB565 *acquireFrameBuffer(const uint32_t pixels) {
+  tgx::RGB565 *frameBuffer = nullptr;
+  int8_t slot;
+  if (pixels <= MAX_KEY_PIXELS &&
+      (slot = takeSlot(keySlotsUsed, STATIC_KEY_SLOTS)) >= 0)
+    frameBuffer = streamdeckKeyFrameBuffers[slot];
+  else if (pixels <= MAX_SCREEN_PIXELS &&
+           (slot = takeSlot(screenSlotsUsed, STATIC_SCREEN_SLOTS)) >= 0)
+    frameBuffer = streamdeckScreenFrameBuffers[slot];
+
+  if (frameBuffer)
+    memset((void *)frameBuffer, 0, pixels * sizeof(tgx::RGB565));
+  return frameBuffer;
+}
+
+void releaseFrameBuffer(tgx::RGB565 *frameBuffer) {
+  for (uint8_t i = 0; i < STATIC_KEY_SLOTS; i++) {
+    if (frameBuffer == streamdeckKeyFrameBuffers[i])
+      keySlotsUsed &= ~(1UL << i);
+  }
+  for (uint8_t i = 0; i < STATIC_SCREEN_SLOTS; i++) {
+    if (frameBuffer == streamdeckScreenFrameBuffers[i])
+      screenSlotsUsed &= ~(1UL << i);
+  }
+}
+
+void *acquireScratch(const uint32_t bytes) {
+  if (scratchUsed || bytes > STATIC_SCRATCH_BYTES)
+    return nullptr;
+  scratchUsed = true;
+  return streamdeckScratch;
+}
+
+void releaseScratch(void *scratch) {
+  if (scratch == streamdeckScratch)
+    scratchUsed = false;
+}
+
+uint8_t *acquireOutBuffer() {
+  if (outBufferUsed)
+    return nullptr;
+  outBufferUsed = true;
+  return streamdeckOutBuffer;
+}
+
+void releaseOutBuffer(uint8_t *buffer) {
+  if (buffer == streamdeckOutBuffer)
+    outBufferUsed = false;
+}
+
+#else
+
+tgx::RGB565 *acquireFrameBuffer(const uint32_t pixels) {
+  return (tgx::RGB565 *)calloc(pixels, sizeof(tgx::RGB565));
+}
+
+void releaseFrameBuffer(tgx::RGB565 *frameBuffer) { free(frameBuffer); }
+
+void *acquireScratch(const uint32_t bytes) { return malloc(bytes); }
+
+void releaseScratch(void *scratch) { free(scratch); }
+
+uint8_t *acquireOutBuffer() {
+  return (uint8_t *)calloc(STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE, 1);
+}
+
+void releaseOutBuffer(uint8_t *buffer) { free(buffer); }
+
+#endif // STREAMDECK_IMAGE_HELPER_STATIC_MEMORY
+
+// One lendable codec instance.
+template <typename T> struct codec_slot_t {
+  T *codec;
+  bool used;
+};
+
+#if STREAMDECK_IMAGE_HELPER_STATIC_MEMORY
+static JPEGDEC streamdeckJpegDecoder;
+static JPEGENC streamdeckJpegEncoder;
+static PNG streamdeckPngDecoder;
+
+static codec_slot_t<JPEGDEC> jpegDecoderSlot = {&streamdeckJpegDecoder, false};
+static codec_slot_t<JPEGENC> jpegEncoderSlot = {&streamdeckJpegEncoder, false};
+static codec_slot_t<PNG> pngDecoderSlot = {&streamdeckPngDecoder, false};
+#else
+static codec_slot_t<JPEGDEC> jpegDecoderSlot = {nullptr, false};
+static codec_slot_t<JPEGENC> jpegEncoderSlot = {nullptr, false};
+static codec_slot_t<PNG> pngDecoderSlot = {nullptr, false};
+#endif // STREAMDECK_IMAGE_HELPER_STATIC_MEMORY
+
+template <typename T> static T *lendCodec(codec_slot_t<T> &slot) {
+  if (slot.used)
+    return nullptr;
+  if (!slot.codec)
+    slot.codec = new T();
+  slot.used = slot.codec != nullptr;
+  return slot.codec;
+}
+
+template <typename T>
+static void returnCodec(codec_slot_t<T> &slot, T *codec) {
+  if (codec && codec == slot.codec)
+    slot.used = false;
+}
+
+JPEGDEC *acquireJpegDecoder() { return lendCodec(jpegDecoderSlot); }
+void releaseJpegDecoder(JPEGDEC *decoder) {
+  returnCodec(jpegDecoderSlot, decoder);
+}
+
+JPEGENC *acquireJpegEncoder() { return lendCodec(jpegEncoderSlot); }
+void releaseJpegEncoder(JPEGENC *encoder) {
+  returnCodec(jpegEncoderSlot, encoder);
+}
+
+PNG *acquirePngDecoder() { return lendCodec(pngDecoderSlot); }
+void releasePngDecoder(PNG *decoder) { returnCodec(pngDecoderSlot, decoder); }
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
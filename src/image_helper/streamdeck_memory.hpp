@@ -0,0 +1,118 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../device_specifics.hpp"
+#include "../../streamdeck_config.hpp"
+#include "../usbhost_driver/streamdeck_usb.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+#include <JPEGDEC.h>
+#include <JPEGENC.h>
+#include <PNGdec.h>
+#include <tgx.h>
+
+namespace Streamdeck {
+
+// Where the Image Helper gets its buffers. By default these are calloc'd and
+// freed; with STREAMDECK_IMAGE_HELPER_STATIC_MEMORY they come from fixed
+// pools reserved at compile time, and acquiring one that is too large or
+// already taken returns nullptr instead of touching the heap.
+
+// Zeroed framebuffer for an Image or ScreenCanvas.
+tgx::RGB565 *acquireFrameBuffer(const uint32_t pixels);
+void releaseFrameBuffer(tgx::RGB565 *frameBuffer);
+
+// Short-lived working memory (transform copies, JPEG block indexes, PNG
+// lines). Not zeroed; release it before acquiring another.
+void *acquireScratch(const uint32_t bytes);
+void releaseScratch(void *scratch);
+
+inline tgx::RGB565 *acquireScratchFrameBuffer(const uint32_t pixels) {
+  return (tgx::RGB565 *)acquireScratch(pixels * sizeof(tgx::RGB565));
+}
+inline void releaseScratchFrameBuffer(tgx::RGB565 *frameBuffer) {
+  releaseScratch(frameBuffer);
+}
+
+// STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE Bytes for an encoded image.
+uint8_t *acquireOutBuffer();
+void releaseOutBuffer(uint8_t *buffer);
+
+// The codecs, one instance of each shared by everything that imports or
+// exports. They carry large internal buffers but are only needed for the
+// length of a call, so Images borrow them rather than embedding their own.
+// Without static memory each is allocated the first time it's asked for and
+// kept. Returns nullptr while the instance is lent out.
+JPEGDEC *acquireJpegDecoder();
+void releaseJpegDecoder(JPEGDEC *decoder);
+JPEGENC *acquireJpegEncoder();
+void releaseJpegEncoder(JPEGENC *encoder);
+PNG *acquirePngDecoder();
+void releasePngDecoder(PNG *decoder);
+
+#if STREAMDECK_IMAGE_HELPER_STATIC_MEMORY
+static_assert(STREAMDECK_IMAGE_HELPER_STATIC_IMAGES <= 32 &&
+                  STREAMDECK_IMAGE_HELPER_STATIC_SCREENS <= 32,
+              "Framebuffer pools are tracked in 32-bit masks");
+
+// Sizes of the static pools, for the enabled models. The scratch buffer holds
+// at least one key framebuffer, for transform().
+constexpr uint32_t STATIC_KEY_SLOTS = STREAMDECK_IMAGE_HELPER_STATIC_IMAGES;
+constexpr uint32_t STATIC_SCREEN_SLOTS =
+    ANY_SCREEN ? STREAMDECK_IMAGE_HELPER_STATIC_SCREENS : 0;
+constexpr uint32_t STATIC_SCRATCH_PIXELS = MAX_KEY_PIXELS;
+
+constexpr size_t STATIC_KEY_POOL_BYTES =
+    STATIC_KEY_SLOTS * MAX_KEY_PIXELS * sizeof(tgx::RGB565);
+constexpr size_t STATIC_SCREEN_POOL_BYTES =
+    STATIC_SCREEN_SLOTS * MAX_SCREEN_PIXELS * sizeof(tgx::RGB565);
+constexpr size_t STATIC_SCRATCH_BYTES =
+    traitMax32(STATIC_SCRATCH_PIXELS * sizeof(tgx::RGB565),
+               STREAMDECK_IMAGE_HELPER_STATIC_SCRATCH_BYTES);
+
+constexpr size_t STATIC_CODEC_BYTES =
+    sizeof(JPEGDEC) + sizeof(JPEGENC) + sizeof(PNG);
+
+// Everything the library reserves for one controller and the Image Helper.
+// Print it (or look up the streamdeck* buffers in the linker map) to see the
+// footprint of a configuration.
+constexpr size_t STATIC_MEMORY_BYTES =
+    sizeof(StreamdeckController) + STATIC_KEY_POOL_BYTES +
+    STATIC_SCREEN_POOL_BYTES + STATIC_SCRATCH_BYTES +
+    STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE + STATIC_CODEC_BYTES;
+
+static_assert(!STREAMDECK_STATIC_MEMORY_LIMIT ||
+                  STATIC_MEMORY_BYTES <= STREAMDECK_STATIC_MEMORY_LIMIT,
+              "Static buffers exceed STREAMDECK_STATIC_MEMORY_LIMIT; enable "
+              "fewer models or shrink the pools");
+#endif // STREAMDECK_IMAGE_HELPER_STATIC_MEMORY
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
@@ -0,0 +1,314 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#include "streamdeck_panel.hpp"
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+namespace Streamdeck {
+
+// JPEGDEC draw callback: copies the block into the band, first finishing the
+// previous band if this block starts a new one. Blocks of an MCU row all
+// share its y.
+int PanelImporter::drawBlock(JPEGDRAW *pDraw) {
+  PanelImporter *panel = (PanelImporter *)pDraw->pUser;
+  if (pDraw->y != panel->bandY) {
+    panel->flushBand();
+    panel->bandY = pDraw->y;
+    panel->bandHeight = min(pDraw->iHeight, panel->bandRows);
+  }
+
+  const int width = min(pDraw->iWidthUsed, panel->bandWidth - pDraw->x);
+  if (width <= 0)
+    return 1;
+  for (int y = 0; y < panel->bandHeight; y++) {
+    memcpy(panel->band + y * panel->bandWidth + pDraw->x,
+           pDraw->pPixels + y * pDraw->iWidth, width * sizeof(uint16_t));
+  }
+  return 1;
+}
+
+// Scales the finished band into the key rows it covers, sending each key row
+// once the band has moved past it.
+void PanelImporter::flushBand() {
+  if (bandY < 0)
+    return;
+
+  const int keyWidth = settings->keyWidth;
+  const int keyHeight = settings->keyHeight;
+  const int pitchX = keyWidth + bezelGap;
+  const int pitchY = keyHeight + bezelGap;
+  const uint32_t keyPixels = (uint32_t)keyWidth * keyHeight;
+
+  const int dyStart = firstMappedDestination(bandY, map.stepY);
+  const int dyEnd = min(firstMappedDestination(bandY + bandHeight, map.stepY),
+                        map.dstHeight);
+  for (int dy = dyStart; dy < dyEnd; dy++) {
+    const int panelY = map.dstY + dy;
+    sendKeyRowsBefore(panelY);
+    const int ty = panelY - sentRows * pitchY;
+    if (sentRows >= settings->keyRows || ty < 0)
+      continue; // Bezel below the last row sent
+
+    const uint16_t *src =
+        band + (mappedSource(dy, map.stepY) - bandY) * bandWidth;
+    for (uint8_t col = 0; col < settings->keyCols; col++) {
+      // Panel columns of this key that the picture covers.
+      const int dxStart = max(col * pitchX - map.dstX, 0);
+      const int dxEnd =
+          min(col * pitchX + keyWidth - map.dstX, map.dstWidth);
+      RGB565 *dst = tiles + col * keyPixels + ty * keyWidth +
+                    (map.dstX - col * pitchX);
+      for (int dx = dxStart; dx < dxEnd; dx++) {
+        dst[dx].val = src[mappedSource(dx, map.stepX)];
+      }
+    }
+  }
+  bandY = -1;
+}
+
+// Sends every key row that ends above panel row panelY.
+void PanelImporter::sendKeyRowsBefore(const int panelY) {
+  const int pitchY = settings->keyHeight + bezelGap;
+  while (sentRows < settings->keyRows &&
+         panelY >= sentRows * pitchY + settings->keyHeight)
+    sendKeyRow();
+}
+
+void PanelImporter::sendKeyRow() {
+  const uint32_t keyPixels = (uint32_t)settings->keyWidth * settings->keyHeight;
+  for (uint8_t col = 0; col < settings->keyCols; col++) {
+    const uint16_t keyIndex = sentRows * settings->keyCols + col;
+    tile.setFrameBuffer(tiles + col * keyPixels, settings);
+    const uint32_t start = micros();
+    if (outBuffer) {
+      const size_t length =
+          tile.exportJpeg(outBuffer, STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE);
+      const uint32_t encoded = micros();
+      timing.encodeMicros += encoded - start;
+      sdc_->setKeyImage(keyIndex, outBuffer, length);
+      timing.queueMicros += micros() - encoded;
+    } else {
+      tile.sendToKey(sdc_, keyIndex);
+      timing.queueMicros += micros() - start;
+    }
+  }
+  for (uint32_t i = 0; i < keyPixels * settings->keyCols; i++) {
+    tiles[i] = background_;
+  }
+  sentRows++;
+}
+
+bool PanelImporter::Task() {
+  if (!sending)
+    return false;
+
+  const uint32_t keyPixels = (uint32_t)settings->keyWidth * settings->keyHeight;
+  while (pendingCol < settings->keyCols) {
+    const uint16_t keyIndex = sentRows * settings->keyCols + pendingCol;
+    tile.setFrameBuffer(tiles + pendingCol * keyPixels, settings);
+    uint32_t start = micros();
+    image_queue_result_t result;
+    if (outBuffer) {
+      // Each tile is encoded once, however many calls it takes to queue.
+      if (!pendingLength) {
+        pendingLength =
+            tile.exportJpeg(outBuffer, STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE);
+        const uint32_t encoded = micros();
+        timing.encodeMicros += encoded - start;
+        start = encoded;
+      }
+      result = pendingLength ? sdc_->trySetKeyImage(keyIndex, outBuffer,
+                                                    pendingLength)
+                             : IMAGE_NO_TARGET;
+      if (result == IMAGE_TOO_LARGE)
+        sdc_->setKeyImage(keyIndex, outBuffer, pendingLength);
+    } else {
+      result = tile.trySendToKey(sdc_, keyIndex);
+      if (result == IMAGE_TOO_LARGE)
+        tile.sendToKey(sdc_, keyIndex);
+    }
+    timing.queueMicros += micros() - start;
+    if (result == IMAGE_QUEUE_FULL)
+      return true;
+    pendingCol++;
+    pendingLength = 0;
+  }
+
+  sentRows++;
+  sending = false;
+  releaseBuffers();
+  return false;
+}
+
+void PanelImporter::cancel() {
+  if (!sending)
+    return;
+  sending = false;
+  releaseBuffers();
+}
+
+void PanelImporter::releaseBuffers() {
+  if (scratch)
+    releaseScratch(scratch);
+  if (outBuffer)
+    releaseOutBuffer(outBuffer);
+  scratch = nullptr;
+  tiles = nullptr;
+  band = nullptr;
+  outBuffer = nullptr;
+}
+
+// Decodes the JPEG the decoder has open across the keys, then closes and
+// releases the decoder. With deferLastRow, the last row of keys is left for
+// Task().
+bool PanelImporter::decode(JPEGDEC *decoder, const RGB565 background,
+                           const bool deferLastRow) {
+  cancel();
+  const uint32_t start = micros();
+  timing = {};
+  settings = sdc_->getSettings();
+  if (!settings || !settings->keyCols || !settings->keyRows ||
+      !settings->keyWidth || !settings->keyHeight) {
+    decoder->close();
+    releaseJpegDecoder(decoder);
+    return false;
+  }
+
+  const int panelWidth =
+      settings->keyCols * (settings->keyWidth + bezelGap) - bezelGap;
+  const int panelHeight =
+      settings->keyRows * (settings->keyHeight + bezelGap) - bezelGap;
+  const int width = decoder->getWidth(), height = decoder->getHeight();
+  const uint8_t shift = jpegScaleShift(width, height, panelWidth, panelHeight);
+  static const int scaleOptions[] = {0, JPEG_SCALE_HALF, JPEG_SCALE_QUARTER,
+                                     JPEG_SCALE_EIGHTH};
+  const int round = (1 << shift) - 1;
+  const int srcWidth = (width + round) >> shift;
+  const int srcHeight = (height + round) >> shift;
+  fitSourceMapping(map, nullptr, panelWidth, panelHeight, srcWidth,
+                   srcHeight, true);
+
+  // The band is one MCU row (at most 16 source rows, fewer when scaled). Its
+  // width is rounded up to whole MCUs, which JPEGDEC may draw in full.
+  bandWidth = (srcWidth + 15) & ~15;
+  bandRows = max(1, (16 + round) >> shift);
+  const uint32_t tileBytes = (uint32_t)settings->keyCols * settings->keyWidth *
+                             settings->keyHeight * sizeof(RGB565);
+  const uint32_t bandBytes = (uint32_t)bandWidth * bandRows * sizeof(uint16_t);
+  scratch = (uint8_t *)acquireScratch(tileBytes + bandBytes);
+  outBuffer = nullptr;
+  if (scratch && settings->imageFormat == IMAGE_FORMAT_JPEG &&
+      !(outBuffer = acquireOutBuffer())) {
+    releaseScratch(scratch);
+    scratch = nullptr;
+  }
+  if (!scratch) {
+    decoder->close();
+    releaseJpegDecoder(decoder);
+    return false;
+  }
+  tiles = (RGB565 *)scratch;
+  band = (uint16_t *)(scratch + tileBytes);
+  background_ = background;
+  for (uint32_t i = 0; i < tileBytes / sizeof(RGB565); i++) {
+    tiles[i] = background;
+  }
+  bandY = -1;
+  sentRows = 0;
+
+  decoder->setUserPointer(this);
+  const bool result = decoder->decode(0, 0, scaleOptions[shift]);
+  decoder->close();
+  releaseJpegDecoder(decoder);
+  const uint8_t lastRow = settings->keyRows - (deferLastRow ? 1 : 0);
+  if (result) {
+    flushBand();
+    while (sentRows < lastRow)
+      sendKeyRow();
+  }
+  timing.decodeMicros =
+      micros() - start - timing.encodeMicros - timing.queueMicros;
+
+  if (result && deferLastRow) {
+    sending = true;
+    pendingCol = 0;
+    pendingLength = 0;
+    Task();
+    return true;
+  }
+  releaseBuffers();
+  return result;
+}
+
+bool PanelImporter::decodeRAM(const uint8_t *inBuffer, const uint32_t inLength,
+                              const RGB565 background,
+                              const bool deferLastRow) {
+  JPEGDEC *decoder = acquireJpegDecoder();
+  if (!decoder)
+    return false;
+  if (!decoder->openRAM((uint8_t *)inBuffer, inLength, drawBlock)) {
+    releaseJpegDecoder(decoder);
+    return false;
+  }
+  return decode(decoder, background, deferLastRow);
+}
+
+bool PanelImporter::importJpeg(const uint8_t *inBuffer, const uint32_t inLength,
+                               const RGB565 background) {
+  return decodeRAM(inBuffer, inLength, background, false);
+}
+
+bool PanelImporter::startJpeg(const uint8_t *inBuffer, const uint32_t inLength,
+                              const RGB565 background) {
+  return decodeRAM(inBuffer, inLength, background, true);
+}
+
+#if STREAMDECK_IMAGE_HELPER_USE_SD
+bool PanelImporter::importJpeg(File file, const RGB565 background) {
+  JPEGDEC *decoder = acquireJpegDecoder();
+  if (!decoder)
+    return false;
+  if (!decoder->open(file, drawBlock)) {
+    releaseJpegDecoder(decoder);
+    return false;
+  }
+  return decode(decoder, background, false);
+}
+
+bool PanelImporter::importJpeg(const char *filePath, const RGB565 background) {
+  if (!SD.exists(filePath))
+    return false;
+
+  File file = SD.open(filePath);
+  const bool result = importJpeg(file, background);
+  file.close();
+  return result;
+}
+#endif // STREAMDECK_IMAGE_HELPER_USE_SD
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
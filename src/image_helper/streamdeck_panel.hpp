@@ -0,0 +1,141 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../device_specifics.hpp"
+#include "../../streamdeck_config.hpp"
+#include "../usbhost_driver/streamdeck_usb.hpp"
+#include "streamdeck_graphics.hpp"
+#include "streamdeck_mapping.hpp"
+#include "streamdeck_memory.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+#include <tgx.h>
+
+#if STREAMDECK_IMAGE_HELPER_USE_SD
+#include <SD.h>
+#endif // STREAMDECK_IMAGE_HELPER_USE_SD
+
+namespace Streamdeck {
+
+// Where the last import's time went, in microseconds. Bitmap decks are
+// rendered straight into the report ring, so their encoding counts as
+// queueing.
+struct panel_timing_t {
+  uint32_t decodeMicros; // Decoding and scaling into the key tiles
+  uint32_t encodeMicros; // Encoding the tiles
+  uint32_t queueMicros;  // Queueing them, including waits for the ring
+};
+
+// Shows one large JPEG across all of a deck's keys. The image is fitted and
+// centred on the key grid (enlarged if need be), optionally with the bezel
+// between keys counted as part of the picture so lines stay straight across
+// it. It is decoded one MCU band at a time, and each row of keys is encoded
+// and sent as soon as the bands covering it are done, so only one band and
+// one row of key framebuffers are ever held, not the whole panel. The decoder
+// can't be paused, so rows finished mid-decode wait for room in the report
+// ring; startJpeg() leaves the last row to Task() instead, which never waits.
+class PanelImporter {
+public:
+  PanelImporter(StreamdeckController *sdc) : sdc_(sdc), tile(nullptr, 0, 0) {}
+
+  // Pixels of bezel between neighbouring keys, at key scale. 0 butts the
+  // keys' pictures against each other.
+  void setBezelGap(const uint16_t gap) { bezelGap = gap; }
+
+  bool importJpeg(const uint8_t *inBuffer, const uint32_t inLength,
+                  RGB565 background = tgx::RGB565_Black);
+#if STREAMDECK_IMAGE_HELPER_USE_SD
+  bool importJpeg(File file, RGB565 background = tgx::RGB565_Black);
+  bool importJpeg(const char *filePath, RGB565 background = tgx::RGB565_Black);
+#endif // STREAMDECK_IMAGE_HELPER_USE_SD
+
+  // Like importJpeg, but the last row of keys is queued by Task() as the
+  // report ring drains. The picture's buffers are held until it is done.
+  bool startJpeg(const uint8_t *inBuffer, const uint32_t inLength,
+                 RGB565 background = tgx::RGB565_Black);
+  // Queues what the report ring has room for of the row startJpeg() left.
+  // Returns true while keys of it remain.
+  bool Task();
+  bool isSending() { return sending; }
+  // Drops the rest of the row startJpeg() left.
+  void cancel();
+
+  // Complete once isSending() is false.
+  const panel_timing_t *getLastTiming() { return &timing; }
+
+private:
+  bool decode(JPEGDEC *decoder, const RGB565 background,
+              const bool deferLastRow);
+  bool decodeRAM(const uint8_t *inBuffer, const uint32_t inLength,
+                 const RGB565 background, const bool deferLastRow);
+  void releaseBuffers();
+  static int drawBlock(JPEGDRAW *pDraw);
+  void flushBand();
+  void sendKeyRowsBefore(const int panelY);
+  void sendKeyRow();
+
+  StreamdeckController *sdc_;
+  device_settings_t *settings = nullptr;
+  // Encodes each key's tile in turn, straight from the row buffer.
+  Image tile;
+  uint16_t bezelGap = 0;
+  RGB565 background_ = tgx::RGB565_Black;
+
+  // Source (after decode scaling) to panel pixels. The panel is the key grid
+  // with bezelGap between keys.
+  source_mapping_t map;
+
+  // The band of decoded source rows being filled: bandWidth x bandRows
+  // pixels, holding source rows [bandY, bandY + bandHeight).
+  uint16_t *band = nullptr;
+  int bandWidth = 0;
+  int bandRows = 0;
+  int bandY = -1;
+  int bandHeight = 0;
+
+  // One row of keys' framebuffers, key after key, and how many key rows have
+  // been sent so far.
+  RGB565 *tiles = nullptr;
+  uint8_t sentRows = 0;
+  uint8_t *scratch = nullptr;
+
+  // JPEG decks: each tile is encoded here, then queued.
+  uint8_t *outBuffer = nullptr;
+
+  // The last key row, left by startJpeg(): the next key of it to queue, and
+  // that key's tile length once encoded into outBuffer (0 before).
+  bool sending = false;
+  uint8_t pendingCol = 0;
+  size_t pendingLength = 0;
+  panel_timing_t timing = {};
+};
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
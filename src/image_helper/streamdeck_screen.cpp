@@ -0,0 +1,218 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#include "streamdeck_screen.hpp"
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+namespace Streamdeck {
+
+static bool boxesTouch(const tgx::iBox2 &a, const tgx::iBox2 &b) {
+  return a.minX <= b.maxX + 1 && b.minX <= a.maxX + 1 &&
+         a.minY <= b.maxY + 1 && b.minY <= a.maxY + 1;
+}
+
+static tgx::iBox2 boxUnion(const tgx::iBox2 &a, const tgx::iBox2 &b) {
+  return tgx::iBox2(min(a.minX, b.minX), max(a.maxX, b.maxX),
+                    min(a.minY, b.minY), max(a.maxY, b.maxY));
+}
+
+static int32_t boxArea(const tgx::iBox2 &box) {
+  return (int32_t)box.lx() * box.ly();
+}
+
+void ScreenCanvas::markDirty(const tgx::iBox2 &box) {
+  // Clip to the canvas, then grow to whole MCUs so regions encode cleanly.
+  tgx::iBox2 aligned(max(box.minX, 0) & ~7, min(box.maxX, width_ - 1) | 7,
+                     max(box.minY, 0) & ~7, min(box.maxY, height_ - 1) | 7);
+  if (aligned.isEmpty())
+    return;
+  if (!regions) {
+    markAllDirty();
+    return;
+  }
+  aligned.maxX = min(aligned.maxX, width_ - 1);
+  aligned.maxY = min(aligned.maxY, height_ - 1);
+
+  addDirty(aligned);
+}
+
+void ScreenCanvas::markAllDirty() {
+  dirty[0] = tgx::iBox2(0, width_ - 1, 0, height_ - 1);
+  dirtyCount = 1;
+}
+
+// Adds a region, folding in any region it touches. When the list is full, the
+// region is folded into whichever existing one grows the least.
+void ScreenCanvas::addDirty(tgx::iBox2 box) {
+  for (uint8_t i = 0; i < dirtyCount;) {
+    if (boxesTouch(box, dirty[i])) {
+      box = boxUnion(box, dirty[i]);
+      dirty[i] = dirty[--dirtyCount];
+      i = 0; // The grown region may now touch earlier ones
+    } else {
+      i++;
+    }
+  }
+
+  if (dirtyCount < STREAMDECK_IMAGE_HELPER_SCREEN_DIRTY_RECTS) {
+    dirty[dirtyCount++] = box;
+    return;
+  }
+
+  uint8_t best = 0;
+  int32_t bestGrowth = INT32_MAX;
+  for (uint8_t i = 0; i < dirtyCount; i++) {
+    const int32_t growth =
+        boxArea(boxUnion(box, dirty[i])) - boxArea(dirty[i]);
+    if (growth < bestGrowth) {
+      bestGrowth = growth;
+      best = i;
+    }
+  }
+  box = boxUnion(box, dirty[best]);
+  dirty[best] = dirty[--dirtyCount];
+  addDirty(box);
+}
+
+// Encodes a region of the canvas in device orientation.
+size_t ScreenCanvas::encodeRegion(uint8_t *outBuffer, const int x, const int y,
+                                  const int w, const int h) {
+  JPEGENC *encoder = acquireJpegEncoder();
+  if (!encoder)
+    return 0;
+
+  JPEGENCODE jpe;
+  encoder->open(outBuffer, STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE);
+  encoder->encodeBegin(&jpe, w, h, JPEGE_PIXEL_RGB565, JPEGE_SUBSAMPLE_444,
+                       JPEGE_Q_HIGH);
+
+  if (!flipH && !flipV && !(w & 7) && !(h & 7)) {
+    // Whole MCUs encode straight out of the canvas; the pitch skips the rest
+    // of each row.
+    encoder->addFrame(&jpe, (uint8_t *)(frameBuffer_ + y * width_ + x),
+                      width_ * 2);
+  } else {
+    // Gather 8x8 MCUs, flipped if need be. Edge MCUs repeat the last
+    // row/column, so a region at the canvas edge (the Stream Deck+ screen is
+    // 100 pixels tall) never reads past the framebuffer.
+    const int32_t stepX = flipH ? -1 : 1;
+    const int32_t stepY = flipV ? -width_ : width_;
+    const tgx::RGB565 *origin = frameBuffer_ +
+                                (flipV ? y + h - 1 : y) * width_ +
+                                (flipH ? x + w - 1 : x);
+    uint16_t mcu[8 * 8];
+
+    for (int mcuY = 0; mcuY < h; mcuY += 8) {
+      for (int mcuX = 0; mcuX < w; mcuX += 8) {
+        for (int row = 0; row < 8; row++) {
+          const tgx::RGB565 *src = origin + min(mcuY + row, h - 1) * stepY;
+          for (int col = 0; col < 8; col++) {
+            mcu[row * 8 + col] = src[min(mcuX + col, w - 1) * stepX].val;
+          }
+        }
+        encoder->addMCU(&jpe, (uint8_t *)mcu, 8 * sizeof(uint16_t));
+      }
+    }
+  }
+
+  const size_t length = encoder->close();
+  releaseJpegEncoder(encoder);
+  return length;
+}
+
+uint16_t ScreenCanvas::sendDirty(StreamdeckController *sdc, const bool wait) {
+  if (!dirtyCount)
+    return 0;
+
+  uint8_t *tempJpgBuffer = acquireOutBuffer();
+  if (!tempJpgBuffer)
+    return 0;
+
+  // Screens without region support must get the whole image in one go.
+  const int maxWidth = regions ? SCREEN_REGION_MAX_WIDTH : width_;
+  uint16_t sent = 0;
+  uint8_t remaining = 0;
+  bool stopped = false;
+  for (uint8_t i = 0; i < dirtyCount; i++) {
+    tgx::iBox2 box = dirty[i];
+    while (!stopped && box.minX <= box.maxX) {
+      // Don't encode what can't be queued anyway.
+      if (!wait &&
+          sdc->getQueuedReports() >= STREAMDECK_USBHOST_OUTPUT_BUFFERS) {
+        stopped = true;
+        break;
+      }
+
+      // A slice that doesn't encode or queue stops the upload; it and
+      // everything after it are kept for the next call.
+      const int x = box.minX;
+      const int w = min(box.maxX + 1 - x, maxWidth);
+      const int h = box.ly();
+      const size_t jpgSize = encodeRegion(tempJpgBuffer, x, box.minY, w, h);
+      if (!jpgSize) {
+        stopped = true;
+        break;
+      }
+
+      // Flipped screens see the region mirrored.
+      const uint16_t screenX = flipH ? width_ - x - w : x;
+      const uint16_t screenY = flipV ? height_ - box.minY - h : box.minY;
+      bool queued = false;
+      if (!wait) {
+        const image_queue_result_t result = sdc->trySetScreenImage(
+            screenX, screenY, w, h, tempJpgBuffer, jpgSize);
+        queued = result == IMAGE_QUEUED;
+        // A slice with more pages than the ring would never fit; waiting for
+        // it is the only way it ever goes out.
+        if (result == IMAGE_TOO_LARGE)
+          queued = sdc->setScreenImage(screenX, screenY, w, h, tempJpgBuffer,
+                                       jpgSize);
+      } else {
+        queued = sdc->setScreenImage(screenX, screenY, w, h, tempJpgBuffer,
+                                     jpgSize);
+      }
+      if (!queued) {
+        stopped = true;
+        break;
+      }
+      sent++;
+      box.minX += w;
+    }
+
+    // The part of a region that wasn't queued stays dirty. Split points are
+    // multiples of SCREEN_REGION_MAX_WIDTH, so it stays MCU aligned.
+    if (box.minX <= box.maxX)
+      dirty[remaining++] = box;
+  }
+  dirtyCount = remaining;
+
+  releaseOutBuffer(tempJpgBuffer);
+  return sent;
+}
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
@@ -0,0 +1,112 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../device_specifics.hpp"
+#include "../../streamdeck_config.hpp"
+#include "../usbhost_driver/streamdeck_usb.hpp"
+#include "streamdeck_memory.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_IMAGE_HELPER_ENABLE
+
+#include <tgx.h>
+
+namespace Streamdeck {
+
+// Uploaded regions are split to at most this width so each one encodes into
+// STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE. This is one dial's segment of the
+// Stream Deck+ touchscreen.
+const uint16_t SCREEN_REGION_MAX_WIDTH = 200;
+
+// A canvas the size of the deck's screen (Stream Deck+ touchscreen, Neo info
+// bar). Draw into it, mark what changed, and sendDirty() encodes and uploads
+// only those regions. Screens that only take whole images are always sent
+// whole.
+class ScreenCanvas {
+public:
+  ScreenCanvas(device_settings_t *settings) {
+    useDeviceSettings(settings);
+    frameBuffer_ = acquireFrameBuffer((uint32_t)width_ * height_);
+    madeFrameBuffer = true;
+    im = tgx::Image<tgx::RGB565>(frameBuffer_, width_, height_);
+  }
+  ScreenCanvas(tgx::RGB565 *frameBuffer, device_settings_t *settings) {
+    useDeviceSettings(settings);
+    frameBuffer_ = frameBuffer;
+    im = tgx::Image<tgx::RGB565>(frameBuffer_, width_, height_);
+  }
+  ~ScreenCanvas() {
+    if (madeFrameBuffer)
+      releaseFrameBuffer(frameBuffer_);
+  }
+
+  tgx::Image<tgx::RGB565> *getTGXImage() { return &im; };
+  tgx::Image<tgx::RGB565> *IM() { return &im; };
+
+  // Marks a rectangle (inclusive bounds) as changed. Call after drawing.
+  void markDirty(const tgx::iBox2 &box);
+  void markAllDirty();
+  bool isDirty() { return dirtyCount > 0; }
+
+  // Encodes and uploads every changed region, then forgets them. Returns the
+  // number of region images queued. With wait false, stops instead of
+  // waiting when the report ring is full; only a region with more pages than
+  // the whole ring is still sent blocking. Whatever wasn't queued, because the
+  // ring was full or a region failed to encode or send, stays dirty for the
+  // next call.
+  uint16_t sendDirty(StreamdeckController *sdc, const bool wait = true);
+
+private:
+  tgx::Image<tgx::RGB565> im;
+
+  void useDeviceSettings(device_settings_t *settings) {
+    width_ = settings->screenWidth;
+    height_ = settings->screenHeight;
+    regions = settings->screenRegions;
+    flipH = settings->screenFlipH;
+    flipV = settings->screenFlipV;
+  }
+  void addDirty(tgx::iBox2 box);
+  size_t encodeRegion(uint8_t *outBuffer, const int x, const int y,
+                      const int w, const int h);
+
+  tgx::RGB565 *frameBuffer_ = nullptr;
+  bool madeFrameBuffer = false;
+  int width_ = 0;
+  int height_ = 0;
+  bool regions = true;
+  bool flipH = false;
+  bool flipV = false;
+
+  // Changed regions, aligned to 8x8 MCUs and kept disjoint.
+  tgx::iBox2 dirty[STREAMDECK_IMAGE_HELPER_SCREEN_DIRTY_RECTS];
+  uint8_t dirtyCount = 0;
+};
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE
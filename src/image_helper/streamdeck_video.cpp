@@ -0,0 +1,242 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#include "streamdeck_video.hpp"
+#if STREAMDECK_IMAGE_HELPER_ENABLE && STREAMDECK_IMAGE_HELPER_USE_SD
+
+namespace Streamdeck {
+
+bool VideoPlayer::play(const char *filePath, const float fps,
+                       const bool loop) {
+  close();
+  if (fps <= 0 || !SD.exists(filePath))
+    return false;
+
+  file = SD.open(filePath);
+  if (!file)
+    return false;
+
+  frameMicros = (uint32_t)(1000000.0f / fps);
+  loop_ = loop;
+  restart();
+  playing = true;
+  nextDue = micros();
+  resetStats();
+  return true;
+}
+
+void VideoPlayer::close() {
+  if (playing)
+    file.close();
+  playing = false;
+  panel.cancel();
+}
+
+void VideoPlayer::restart() {
+  file.seek(0);
+  filled = 0;
+  frameLength = 0;
+  scanPos = 0;
+  scanState = SCAN_START;
+}
+
+// Finds where the JPEG at the start of data ends, carrying on from where the
+// last call stopped. Marker segments are skipped by their lengths, so bytes in
+// APP segments (EXIF thumbnails) can't end a frame early. In entropy-coded
+// data a 0xFF is always followed by a stuffed 0x00 or a restart marker, so
+// anything else there is the next segment or EOI. Returns the frame's length,
+// or 0 if more data is needed.
+uint32_t VideoPlayer::scanFrame() {
+  for (;;) {
+    switch (scanState) {
+    case SCAN_START: {
+      // Discard anything before the next SOI, keeping a trailing 0xFF.
+      uint32_t i = 0;
+      while (i + 1 < filled && !(data[i] == 0xff && data[i + 1] == 0xd8))
+        i++;
+      if (i + 1 >= filled) {
+        const uint32_t keep = filled && data[filled - 1] == 0xff ? 1 : 0;
+        memmove(data, data + filled - keep, keep);
+        filled = keep;
+        return 0;
+      }
+      memmove(data, data + i, filled - i);
+      filled -= i;
+      scanPos = 2;
+      scanState = SCAN_MARKERS;
+      break;
+    }
+
+    case SCAN_MARKERS: {
+      if (scanPos + 2 > filled)
+        return 0;
+      if (data[scanPos] != 0xff) {
+        // Not a JPEG after all: look for the next SOI.
+        data[0] = 0;
+        scanState = SCAN_START;
+        break;
+      }
+      const uint8_t marker = data[scanPos + 1];
+      if (marker == 0xff) {
+        scanPos++; // Fill byte
+      } else if (marker == 0xd9) {
+        return scanPos + 2;
+      } else if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+        scanPos += 2;
+      } else {
+        if (scanPos + 4 > filled)
+          return 0;
+        if (marker == 0xda)
+          scanState = SCAN_ENTROPY;
+        scanPos += 2 + (data[scanPos + 2] << 8 | data[scanPos + 3]);
+      }
+      break;
+    }
+
+    case SCAN_ENTROPY: {
+      if (scanPos + 1 >= filled)
+        return 0;
+      const uint8_t *ff = (const uint8_t *)memchr(data + scanPos, 0xff,
+                                                  filled - 1 - scanPos);
+      if (!ff) {
+        scanPos = filled - 1;
+        return 0;
+      }
+      scanPos = ff - data;
+      const uint8_t next = data[scanPos + 1];
+      if (next == 0x00 || (next >= 0xd0 && next <= 0xd7))
+        scanPos += 2;
+      else if (next == 0xff)
+        scanPos++;
+      else
+        scanState = SCAN_MARKERS;
+      break;
+    }
+    }
+  }
+}
+
+// Reads at most one chunk towards a whole frame at the start of data, and
+// sets frameLength once there is one. Frames too large for the buffer are
+// dropped. Returns false at the end of the file.
+bool VideoPlayer::readFrame() {
+  frameLength = scanFrame();
+  if (frameLength)
+    return true;
+
+  if (filled + VIDEO_READ_CHUNK > sizeof(data)) {
+    stats.framesDropped++;
+    nextDue += frameMicros;
+    filled = 0;
+    scanState = SCAN_START;
+    return true;
+  }
+
+  const int count = file.read(data + filled, VIDEO_READ_CHUNK);
+  if (count <= 0)
+    return false;
+  filled += count;
+  frameLength = scanFrame();
+  return true;
+}
+
+// Moves what was read past the current frame to the start of the buffer.
+void VideoPlayer::consumeFrame() {
+  filled -= frameLength;
+  memmove(data, data + frameLength, filled);
+  frameLength = 0;
+  scanPos = 0;
+  scanState = SCAN_START;
+}
+
+// Counts the shown frame's stage times once all of it is queued.
+void VideoPlayer::addFrameTiming() {
+  const panel_timing_t *timing = panel.getLastTiming();
+  stats.decodeMicros += timing->decodeMicros;
+  stats.encodeMicros += timing->encodeMicros;
+  stats.queueMicros += timing->queueMicros;
+}
+
+bool VideoPlayer::Task() {
+  if (!playing)
+    return false;
+
+  // The shown frame's bottom row goes out as the ring drains, while the next
+  // frame is read.
+  if (panel.isSending() && !panel.Task())
+    addFrameTiming();
+
+  if (!frameLength) {
+    const uint32_t start = micros();
+    const bool read = readFrame();
+    stats.readMicros += micros() - start;
+    if (!read) {
+      if (panel.isSending())
+        return true;
+      if (!loop_) {
+        close();
+        return false;
+      }
+      restart();
+    }
+    return true;
+  }
+
+  const int32_t late = (int32_t)(micros() - nextDue);
+  if (late < 0 || (panel.isSending() && late < (int32_t)frameMicros))
+    return true;
+
+  // Once the following frame is due as well, this one is dropped unseen.
+  if (late < (int32_t)frameMicros && panel.startJpeg(data, frameLength)) {
+    stats.framesShown++;
+    if (!panel.isSending())
+      addFrameTiming();
+  } else {
+    stats.framesDropped++;
+  }
+  consumeFrame();
+  nextDue += frameMicros;
+  return true;
+}
+
+const video_stats_t *VideoPlayer::getStats() {
+  stats.elapsedMicros = micros() - statsStart;
+  return &stats;
+}
+
+float VideoPlayer::getFps() {
+  const uint32_t elapsed = micros() - statsStart;
+  return elapsed ? stats.framesShown * 1000000.0f / elapsed : 0;
+}
+
+void VideoPlayer::resetStats() {
+  stats = {};
+  statsStart = micros();
+}
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE && STREAMDECK_IMAGE_HELPER_USE_SD
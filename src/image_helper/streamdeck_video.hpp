@@ -0,0 +1,118 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../device_specifics.hpp"
+#include "../../streamdeck_config.hpp"
+#include "../usbhost_driver/streamdeck_usb.hpp"
+#include "streamdeck_panel.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_IMAGE_HELPER_ENABLE && STREAMDECK_IMAGE_HELPER_USE_SD
+
+#include <SD.h>
+
+namespace Streamdeck {
+
+// Bytes read from the card at a time.
+const uint16_t VIDEO_READ_CHUNK = 8192;
+
+static_assert(STREAMDECK_IMAGE_HELPER_VIDEO_BUFFER_SIZE > VIDEO_READ_CHUNK,
+              "STREAMDECK_IMAGE_HELPER_VIDEO_BUFFER_SIZE must exceed one read");
+
+// Totals since play() or resetStats(). Stage times are summed over the frames
+// shown; divide by framesShown for the per-frame cost.
+struct video_stats_t {
+  uint32_t framesShown;
+  uint32_t framesDropped; // Skipped for being late or too large
+  uint32_t elapsedMicros;
+  uint64_t readMicros;   // Reading from the card and finding frame ends
+  uint64_t decodeMicros; // Decoding and scaling into key tiles
+  uint64_t encodeMicros; // Encoding the tiles
+  uint64_t queueMicros;  // Queueing them, including waits for the ring
+};
+
+// Plays an MJPEG file (JPEG frames back to back, as written by
+// `ffmpeg -i in.mp4 -vf scale=480:-1 -q:v 5 out.mjpeg`) across all keys of a
+// deck at a fixed frame rate. Each frame goes through a PanelImporter:
+// decoded at a reduced scale, sliced into key tiles and encoded as it goes.
+// Each Task() queues what the report ring has room for of the shown frame's
+// bottom key row, then reads one chunk from the card or decodes the next frame
+// once it is due. So card reads overlap the bottom row's upload, but the rows
+// above it are queued while the frame decodes and wait there whenever the
+// ring is full. When playback falls behind, late frames are read past without
+// being decoded, so the video keeps its speed and loses frame rate instead.
+class VideoPlayer {
+public:
+  VideoPlayer(StreamdeckController *sdc) : panel(sdc) {}
+  ~VideoPlayer() { close(); }
+
+  bool play(const char *filePath, const float fps, const bool loop = false);
+  void close();
+  bool isPlaying() { return playing; }
+
+  // For setBezelGap().
+  PanelImporter *getPanel() { return &panel; }
+
+  // Call from loop(). Shows or drops the next frame once it is due. Returns
+  // false once the video has ended.
+  bool Task();
+
+  const video_stats_t *getStats();
+  float getFps();
+  void resetStats();
+
+private:
+  enum scan_state_t { SCAN_START, SCAN_MARKERS, SCAN_ENTROPY };
+
+  bool readFrame();
+  uint32_t scanFrame();
+  void consumeFrame();
+  void restart();
+  void addFrameTiming();
+
+  PanelImporter panel;
+  File file;
+  bool playing = false;
+  bool loop_ = false;
+  uint32_t frameMicros = 0;
+  uint32_t nextDue = 0; // micros() at which the buffered frame is shown
+
+  // data[0, filled) holds the file from the start of the next frame on.
+  // Once frameLength is set, that much of it is a whole JPEG.
+  uint8_t data[STREAMDECK_IMAGE_HELPER_VIDEO_BUFFER_SIZE];
+  uint32_t filled = 0;
+  uint32_t frameLength = 0;
+  uint32_t scanPos = 0;
+  scan_state_t scanState = SCAN_START;
+
+  video_stats_t stats = {};
+  uint32_t statsStart = 0;
+};
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_IMAGE_HELPER_ENABLE && STREAMDECK_IMAGE_HELPER_USE_SD
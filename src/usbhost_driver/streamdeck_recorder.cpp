@@ -0,0 +1,151 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#include "streamdeck_recorder.hpp"
+#if STREAMDECK_USBHOST_ENABLE_RECORDER
+
+namespace Streamdeck {
+
+bool InputRecorder::begin(Print &out, const uint16_t productId) {
+  recording_header_t header = {{'S', 'D', 'I', 'R'}, RECORDING_VERSION,
+                               productId, 0};
+  if (out.write((const uint8_t *)&header, sizeof(header)) != sizeof(header))
+    return false;
+
+  head = tail = 0;
+  recorded = dropped = 0;
+  lastTime = micros();
+  out_ = &out;
+  return true;
+}
+
+void InputRecorder::end() {
+  flush();
+  out_ = nullptr;
+  lastTime = 0;
+}
+
+// Runs in the input ISR, so only copies. Reports arriving while the ring is
+// full are counted and dropped.
+void InputRecorder::capture(const uint8_t *report, const uint16_t length) {
+  if (!out_)
+    return;
+
+  if ((uint16_t)(head - tail) >= STREAMDECK_USBHOST_RECORDER_BUFFERS) {
+    dropped++;
+    return;
+  }
+
+  uint16_t trimmed = min(length, RECORDING_REPORT_LENGTH);
+  while (trimmed && report[trimmed - 1] == 0)
+    trimmed--;
+
+  capture_t &slot = captures[head & (STREAMDECK_USBHOST_RECORDER_BUFFERS - 1)];
+  slot.time = micros();
+  slot.length = trimmed;
+  memcpy(slot.data, report, trimmed);
+  head++;
+}
+
+void InputRecorder::flush() {
+  if (!out_)
+    return;
+
+  while (tail != head) {
+    const capture_t &slot =
+        captures[tail & (STREAMDECK_USBHOST_RECORDER_BUFFERS - 1)];
+    recording_record_t record;
+    record.deltaMicros = slot.time - lastTime;
+    record.length = slot.length;
+    lastTime = slot.time;
+
+    out_->write((const uint8_t *)&record, sizeof(record));
+    out_->write(slot.data, slot.length);
+    recorded++;
+    tail++;
+  }
+}
+
+bool InputReplayer::begin(Stream &in, StreamdeckController *sdc) {
+  recording_header_t header;
+  if (in.readBytes((char *)&header, sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, "SDIR", 4) != 0 ||
+      header.version != RECORDING_VERSION)
+    return false;
+
+  if (!sdc->beginReplay(header.productId))
+    return false;
+
+  in_ = &in;
+  sdc_ = sdc;
+  replayed = 0;
+  dueTime = 0;
+  startTime = micros();
+  return readNext();
+}
+
+void InputReplayer::end() {
+  in_ = nullptr;
+  sdc_ = nullptr;
+  hasNext = false;
+}
+
+// Reads the next record into the report buffer and advances the due time.
+bool InputReplayer::readNext() {
+  recording_record_t record;
+  hasNext = false;
+  if (in_->readBytes((char *)&record, sizeof(record)) != sizeof(record) ||
+      record.length > RECORDING_REPORT_LENGTH)
+    return false;
+  if (in_->readBytes((char *)report, record.length) != record.length)
+    return false;
+
+  memset(report + record.length, 0, RECORDING_REPORT_LENGTH - record.length);
+  length = RECORDING_REPORT_LENGTH;
+  dueTime += record.deltaMicros;
+  hasNext = true;
+  return true;
+}
+
+bool InputReplayer::Task() {
+  while (hasNext && micros() - startTime >= dueTime) {
+    step();
+  }
+  return hasNext;
+}
+
+bool InputReplayer::step() {
+  if (!hasNext)
+    return false;
+
+  sdc_->injectInputReport(report, length);
+  replayed++;
+  return readNext();
+}
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
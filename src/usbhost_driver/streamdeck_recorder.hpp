@@ -0,0 +1,122 @@
+/*
+Copyright 2024 Aria Burrell <litui@litui.ca>
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the “Software”),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+Some ideas borrowed from the python-elgato-streamdeck library.
+Credit to:
+   dean [at] fourwalledcubicle [dot] com
+         www.fourwalledcubicle.com
+*/
+#pragma once
+#include "../../streamdeck_config.hpp"
+#include "streamdeck_usb.hpp"
+#include <Arduino.h>
+
+#if STREAMDECK_USBHOST_ENABLE_RECORDER
+
+namespace Streamdeck {
+
+static_assert((STREAMDECK_USBHOST_RECORDER_BUFFERS &
+               (STREAMDECK_USBHOST_RECORDER_BUFFERS - 1)) == 0,
+              "STREAMDECK_USBHOST_RECORDER_BUFFERS must be a power of 2");
+
+// Recording layout (all fields little endian):
+//   header:  recording_header_t
+//   records: recording_record_t followed by `length` bytes of report
+// Trailing zero bytes of each 512-byte report are not stored; the replayer
+// pads them back in.
+struct __attribute__((packed)) recording_header_t {
+  char magic[4]; // "SDIR"
+  uint16_t version;
+  uint16_t productId;
+  uint32_t reserved;
+};
+
+struct __attribute__((packed)) recording_record_t {
+  uint32_t deltaMicros; // Since the previous record (or begin())
+  uint16_t length;
+};
+
+const uint16_t RECORDING_VERSION = 1;
+const uint16_t RECORDING_REPORT_LENGTH = 512;
+
+// Logs raw input reports with their arrival times. Attach it with
+// StreamdeckController::attachRecorder(); reports are captured in the ISR
+// and written out to the Print (usually an SD File) from Task().
+class InputRecorder {
+public:
+  bool begin(Print &out, const uint16_t productId);
+  void end();
+
+  void capture(const uint8_t *report, const uint16_t length);
+  void flush();
+
+  uint32_t getRecordedReports() { return recorded; }
+  uint32_t getDroppedReports() { return dropped; }
+
+private:
+  struct capture_t {
+    uint32_t time;
+    uint16_t length;
+    uint8_t data[RECORDING_REPORT_LENGTH];
+  };
+
+  capture_t captures[STREAMDECK_USBHOST_RECORDER_BUFFERS];
+  volatile uint16_t head = 0;
+  volatile uint16_t tail = 0;
+
+  Print *out_ = nullptr;
+  uint32_t lastTime = 0;
+  uint32_t recorded = 0;
+  volatile uint32_t dropped = 0;
+};
+
+// Feeds a recording back into a controller through the same parsing path as
+// live reports, either on the recorded timeline (Task) or as fast as the
+// caller likes (step). Works with no deck attached.
+class InputReplayer {
+public:
+  bool begin(Stream &in, StreamdeckController *sdc);
+  void end();
+
+  // Injects every report that is due relative to begin(). Returns false once
+  // the recording is exhausted.
+  bool Task();
+  // Injects the next report straight away. Returns false at the end.
+  bool step();
+
+  uint32_t getReplayedReports() { return replayed; }
+
+private:
+  bool readNext();
+
+  Stream *in_ = nullptr;
+  StreamdeckController *sdc_ = nullptr;
+  uint8_t report[RECORDING_REPORT_LENGTH];
+  uint16_t length = 0;
+  bool hasNext = false;
+  uint32_t startTime = 0;
+  uint32_t dueTime = 0;
+  uint32_t replayed = 0;
+};
+
+} // namespace Streamdeck
+
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
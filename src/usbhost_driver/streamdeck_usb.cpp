@@ -25,9 +25,37 @@ Credit to:
          www.fourwalledcubicle.com
 */
 #include "streamdeck_usb.hpp"
+#include "streamdeck_recorder.hpp"
 
 namespace Streamdeck {
 
+typedef void (*legacy_single_press_t)(StreamdeckController *sdc,
+                                      const uint16_t keyIndex,
+                                      const uint8_t newValue,
+                                      const uint8_t oldValue);
+typedef void (*legacy_any_change_t)(StreamdeckController *sdc,
+                                    keyState_t *states);
+typedef void (*legacy_key_held_t)(StreamdeckController *sdc,
+                                  const uint16_t keyIndex);
+
+// Trampolines adapting the context-free attach* hooks to the subscriber table.
+// The hook itself travels as the subscriber context.
+static void legacySinglePress(StreamdeckController *sdc,
+                              const key_event_t *event, void *context) {
+  ((legacy_single_press_t)context)(sdc, event->keyIndex, event->newValue,
+                                   event->oldValue);
+}
+
+static void legacyAnyChange(StreamdeckController *sdc, const key_event_t *event,
+                            void *context) {
+  ((legacy_any_change_t)context)(sdc, (keyState_t *)event->states);
+}
+
+static void legacyKeyHeld(StreamdeckController *sdc, const key_event_t *event,
+                          void *context) {
+  ((legacy_key_held_t)context)(sdc, event->keyIndex);
+}
+
 void StreamdeckController::init() {
   USBHost::contribute_Pipes(mypipes, sizeof(mypipes) / sizeof(Pipe_t));
   USBHost::contribute_Transfers(mytransfers,
@@ -44,78 +72,377 @@ hidclaim_t StreamdeckController::claim_collection(USBHIDParser *driver,
   if (dev->idVendor != USB_VID_ELGATO)
     return CLAIM_NO;
 
-  for (uint8_t i = 0; i < sizeof(DeviceList)/sizeof(device_settings_t); i++) {
-    if (dev->idProduct == DeviceList[i].productId) {
-      // Serial.println("Found product!");
-      settings = (device_settings_t*)&DeviceList[i];
-    }
-  }
-  if (!settings)
+  if (!selectDevice(dev->idProduct))
     return CLAIM_NO;
-  
-  // Reserve memory in the correct counts for state tracking
-  states = (keyState_t*) calloc(settings->keyCount, sizeof(keyState_t));
-  
+
   mydevice = dev;
   collections_claimed++;
 
   driver_ = driver;
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
   driver_->setTXBuffers(drv_tx1_, drv_tx2_, 0);
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
 
   return CLAIM_INTERFACE;
 }
 
+// Looks up the settings for a product and starts state tracking from a clean
+// slate.
+bool StreamdeckController::selectDevice(const uint16_t productId) {
+  settings = nullptr;
+  for (uint8_t i = 0; i < sizeof(DeviceList)/sizeof(device_settings_t); i++) {
+    if (productId == DeviceList[i].productId) {
+      // Serial.println("Found product!");
+      settings = (device_settings_t*)&DeviceList[i];
+      break;
+    }
+  }
+  if (!settings) {
+    settings = nullptr;
+    return false;
+  }
+
+  memset(snapshots, 0, sizeof(snapshots));
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+  latencyStampedKeys = 0;
+  latencyAwaitingKeys = 0;
+  memset(imagesQueued, 0, sizeof(imagesQueued));
+  memset(imagesCompleted, 0, sizeof(imagesCompleted));
+  resetLatency();
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  memset(dialInput, 0, sizeof(dialInput));
+  touchHead = 0;
+  touchTail = 0;
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+  deviceInfoReady = 0;
+  deviceInfoPending = -1;
+  frontIndex = 0;
+  inputSequence = 0;
+  unresolvedHeldKeys = 0;
+  changedKeys = 0;
+  heldKeys = 0;
+  batchKeys = 0;
+  pendingPressKeys = 0;
+  return true;
+}
+
 void StreamdeckController::disconnect_collection(Device_t *dev) {
   if (--collections_claimed == 0U) {
-    free(states);
     settings = nullptr;
     mydevice = NULL;
   }
 }
 
 bool StreamdeckController::hid_process_in_data(const Transfer_t *transfer) {
-  if (transfer->length != 512U)
+  if (!settings)
+    return false;
+
+#if STREAMDECK_USBHOST_ENABLE_RECORDER
+  if (recorder_)
+    recorder_->capture((const uint8_t *)transfer->buffer, transfer->length);
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
+
+  return processInputReport((const uint8_t *)transfer->buffer,
+                            transfer->length);
+}
+
+#if STREAMDECK_USBHOST_ENABLE_RECORDER
+bool StreamdeckController::beginReplay(const uint16_t productId) {
+  if (mydevice)
+    return false;
+  return selectDevice(productId);
+}
+
+void StreamdeckController::injectInputReport(const uint8_t *report,
+                                             const uint16_t length) {
+  if (settings)
+    processInputReport(report, length);
+}
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
+
+// Applies one raw input report to the back key state snapshot. Shared by the
+// USB input path and replay.
+bool StreamdeckController::processInputReport(const uint8_t *data,
+                                              const uint16_t length) {
+  // Touch keys are reported (and tracked) after the regular keys.
+  const uint16_t keyCount = device()->keyCount + device()->touchKeyCount;
+  if (!length || data[0] != HID_REPORT_TYPE_IN)
     return false;
 
-  report_type_512_4_in_t *report =
-      (report_type_512_4_in_t *)transfer->buffer;
-  if (report->reportType != HID_REPORT_TYPE_IN)
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  if (MAX_DIAL_COUNT && device()->dialCount && length > 1 &&
+      data[1] != CONTROL_REPORT_KEYS) {
+    processControlReport(data, length);
+    return true;
+  }
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+
+  if (length < device()->inputReportHeaderLength + keyCount)
     return false;
+  const uint8_t *reportStates = data + device()->inputReportHeaderLength;
+
+  keySnapshot_t &next = snapshots[frontIndex ^ 1];
+  const keySnapshot_t &published = snapshots[frontIndex];
+
+  // Once published, the back snapshot is older than the front one; bring it
+  // up to date before applying this report on top of it.
+  if (next.sequence <= published.sequence) {
+    next.state = published.state;
+    next.lastState = published.lastState;
+    memcpy(next.changedTime, published.changedTime,
+           keyCount * sizeof(uint32_t));
+    next.changed = 0;
+    next.sequence = published.sequence;
+  }
+
+  // Gather the report into a bitmap and diff it against the snapshot in one
+  // go.
+  keyMask_t reported = 0;
+  for (uint16_t i = 0; i < keyCount; i++) {
+    if (reportStates[deviceKeyIndex(i)])
+      reported |= keyBit(i);
+  }
+  const keyMask_t changed = reported ^ next.state;
+
+  if (changed) {
+    // Track time that a key was pressed.
+    const uint32_t now = millis();
+    keyMask_t pending = changed;
+    while (pending) {
+      next.changedTime[__builtin_ctz(pending)] = now;
+      pending &= pending - 1;
+    }
+    next.lastState = (next.lastState & ~changed) | (next.state & changed);
+    next.state = reported;
+  }
 
-  for (uint16_t i = 0; i < settings->keyCount; i++) {
-    // Report differences in key states.
-    if (report->states[i] != states[i].state) {
-      // Track time that a key was pressed.
-      states[i].changedTime = millis();
-      states[i].lastState = states[i].state;
-      states[i].state = report->states[i];
-      states[i].changed = true;
-      states[i].holdResolved = false;
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+  // Stamp transitions; the first one since the key's last answered image
+  // counts.
+  keyMask_t stamp = changed & ~latencyStampedKeys;
+  if (stamp) {
+    const uint32_t now = micros();
+    latencyStampedKeys |= stamp;
+    while (stamp) {
+      latencyStamp[__builtin_ctz(stamp)] = now;
+      stamp &= stamp - 1;
     }
   }
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+
+  // Only a newer sequence number makes Task() publish the snapshot.
+  if (changed) {
+    next.changed |= changed;
+    next.sequence = ++inputSequence;
+  }
   return true;
 }
 
-bool StreamdeckController::hid_process_out_data(const Transfer_t *transfer) {
-  // USBHDBGSerial.printf("HID output success, length: %u\n", transfer->length);
-  if (!pending_out_reports.empty()) {
-    report_type_1024_8_out_t *report =
-        (report_type_1024_8_out_t *)pending_out_reports.front();
-    // USBHDBGSerial.printf("Resuming transfer of payload #%u.\n",
-    // report->payloadNumber);
-    if (driver_->sendPacket((const uint8_t *)report,
-                            sizeof(report_type_1024_8_out_t))) {
-      pending_out_reports.pop();
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+// Decodes a Stream Deck+ dial or touchscreen report. Dial input is folded into
+// dialInput; touch gestures are queued whole.
+void StreamdeckController::processControlReport(const uint8_t *data,
+                                                const uint16_t length) {
+  const uint32_t now = micros();
+
+  if (data[1] == CONTROL_REPORT_DIALS) {
+    if (length < 5U + device()->dialCount)
+      return;
+
+    const bool turn = data[4] == 0x01;
+    for (uint8_t i = 0; i < device()->dialCount; i++) {
+      dialInput_t &dial = dialInput[i];
+      const uint8_t value = data[5 + i];
+      if (turn) {
+        if (value) {
+          dial.delta += (int8_t)value;
+          dial.turnTime = now;
+        }
+      } else if ((value != 0) != dial.pressed) {
+        dial.pressed = value != 0;
+        if (dial.pressTransitions < 0xff)
+          dial.pressTransitions++;
+        dial.pressTime = now;
+      }
     }
+    return;
   }
+
+  if (data[1] != CONTROL_REPORT_TOUCHSCREEN || length < 14)
+    return;
+
+  control_event_type_t type;
+  switch (data[4]) {
+  case 1:
+    type = CONTROL_EVENT_TOUCH_TAP;
+    break;
+  case 2:
+    type = CONTROL_EVENT_TOUCH_PRESS;
+    break;
+  case 3:
+    type = CONTROL_EVENT_TOUCH_SWIPE;
+    break;
+  default:
+    return;
+  }
+
+  // Drop gestures while the queue is full.
+  if ((uint8_t)(touchHead - touchTail) >= STREAMDECK_USBHOST_TOUCH_EVENTS)
+    return;
+
+  control_event_t &event =
+      touchEvents[touchHead & (STREAMDECK_USBHOST_TOUCH_EVENTS - 1)];
+  memset(&event, 0, sizeof(event));
+  event.type = type;
+  event.control = CONTROL_TYPE_TOUCHSCREEN;
+  event.x = data[6] | (data[7] << 8);
+  event.y = data[8] | (data[9] << 8);
+  if (type == CONTROL_EVENT_TOUCH_SWIPE) {
+    event.xOut = data[10] | (data[11] << 8);
+    event.yOut = data[12] | (data[13] << 8);
+  }
+  event.timestamp = now;
+  touchHead++;
+}
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+
+bool StreamdeckController::hid_process_out_data(const Transfer_t *transfer) {
+  // USBHDBGSerial.printf("HID output success, length: %u\n", transfer->length);
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+  // The transfer buffer still holds the report that just went out.
+  latencyImageSent((const uint8_t *)transfer->buffer);
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  // A transfer buffer just freed up; hand it the next queued report.
+  sendQueuedReports();
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
   return true;
 }
 
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+// Hands queued reports to the driver until it runs out of transfer buffers.
+// Runs in the out-data ISR; other callers go through pumpQueuedReports().
+void StreamdeckController::sendQueuedReports() {
+  if (sendingReports)
+    return;
+  sendingReports = true;
+
+  while (reportTail != reportHead) {
+    const uint8_t *report =
+        reportSlots[reportTail & (STREAMDECK_USBHOST_OUTPUT_BUFFERS - 1)];
+    if (!driver_->sendPacket(report, device()->imageReportLength))
+      break;
+    reportTail++;
+  }
+
+  sendingReports = false;
+}
+
+void StreamdeckController::pumpQueuedReports() {
+  __disable_irq();
+  sendQueuedReports();
+  __enable_irq();
+}
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+
+// Where each protocol keeps its identification strings: the feature report
+// to read, its length and the offset of the string within it.
+struct device_info_report_t {
+  uint8_t reportId;
+  uint8_t length;
+  uint8_t offset;
+};
+
+static const device_info_report_t
+    deviceInfoReports[][DEVICE_INFO_COUNT] = {
+        // REPORT_PROTOCOL_GEN1
+        {{0x04, 17, 5}, {0x03, 17, 5}},
+        // REPORT_PROTOCOL_GEN2
+        {{0x05, 32, 6}, {0x06, 32, 2}},
+};
+
+static const device_info_report_t *
+deviceInfoReport(const report_protocol_t protocol, const uint8_t info) {
+  return &deviceInfoReports[protocol == REPORT_PROTOCOL_GEN1 ? 0 : 1][info];
+}
+
 bool StreamdeckController::hid_process_control(const Transfer_t *transfer) {
   // USBHDBGSerial.printf("HID Control...\n");
+  const int8_t info = deviceInfoPending;
+  if (info < 0 || !settings || transfer->buffer != featureBuffer)
+    return true;
+
+  // A late answer to a read that already timed out is ignored.
+  const device_info_report_t *source =
+      deviceInfoReport(device()->protocol, info);
+  if ((transfer->setup.wValue & 0xffU) != source->reportId)
+    return true;
+
+  char *dst = deviceInfo[info];
+  uint8_t length = 0;
+  if (transfer->length > source->offset) {
+    const uint8_t *src = featureBuffer + source->offset;
+    const uint8_t available = min(transfer->length, source->length) -
+                              source->offset;
+    // The strings are zero or space padded; keep the printable part.
+    while (length < available && length < DEVICE_INFO_MAX_LENGTH - 1 &&
+           src[length] >= 0x20 && src[length] < 0x7f) {
+      dst[length] = src[length];
+      length++;
+    }
+    while (length && dst[length - 1] == ' ')
+      length--;
+  }
+  dst[length] = 0;
+
+  deviceInfoReady |= 1U << info;
+  deviceInfoPending = -1;
   return true;
 }
 
+bool StreamdeckController::getReport(const uint8_t reportType,
+                                     const uint8_t reportId,
+                                     const uint8_t interface, void *report,
+                                     const uint16_t length) {
+  return driver_->sendControlPacket(
+      0xa1U, // bmRequestType = 10100001, Class-specific requests, IN
+      0x01U, // GET_REPORT (s. 7.2.1 of DCD for USB HID v1.11)
+      (uint16_t)((reportType << 8) | reportId), interface, length, report);
+}
+
+// Starts the next device info read that has not been answered yet. Only one
+// is in flight at a time since they share featureBuffer. A read the deck
+// never answers, or that could not be sent, is given up after a second and
+// asked again, so a lost transfer only delays the info.
+void StreamdeckController::requestDeviceInfo() {
+  if (deviceInfoPending >= 0) {
+    if (millis() - deviceInfoRequestTime < 1000)
+      return;
+    deviceInfoPending = -1;
+  }
+
+  for (uint8_t info = 0; info < DEVICE_INFO_COUNT; info++) {
+    if (deviceInfoReady & (1U << info))
+      continue;
+
+    const device_info_report_t *source =
+        deviceInfoReport(device()->protocol, info);
+    deviceInfoPending = info;
+    deviceInfoRequestTime = millis();
+    getReport(HID_REPORT_TYPE_FEATURE, source->reportId, 0, featureBuffer,
+              source->length);
+    return;
+  }
+}
+
+const char *StreamdeckController::getDeviceInfo(const device_info_t info) {
+  if (info >= DEVICE_INFO_COUNT || !(deviceInfoReady & (1U << info)))
+    return nullptr;
+  return deviceInfo[info];
+}
+
 bool StreamdeckController::setReport(const uint8_t reportType,
                                      const uint8_t reportId,
                                      const uint8_t interface, void *report,
@@ -126,17 +453,39 @@ bool StreamdeckController::setReport(const uint8_t reportType,
       (uint16_t)((reportType << 8) | reportId), interface, length, report);
 }
 
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
 void StreamdeckController::setBrightness(float percent) {
+  if (!settings || !device()->imageReportLength)
+    return;
+
+  const uint8_t value = (uint8_t)min(100, max(percent * 100, 0));
+
+  if (ANY_GEN1 && device()->protocol == REPORT_PROTOCOL_GEN1) {
+    static report_type_17_6_feature_t report;
+    memset(&report, 0, sizeof(report));
+    report.reportType = 0x05;
+    report.command[0] = 0x55;
+    report.command[1] = 0xaa;
+    report.command[2] = 0xd1;
+    report.command[3] = 0x01;
+    report.value = value;
+
+    setReport(HID_REPORT_TYPE_FEATURE, report.reportType, 0, &report,
+              sizeof(report));
+    return;
+  }
+
   static report_type_32_3_out_t report;
   report.reportType = 0x03;
   report.request = 0x08;
-  report.value = (uint8_t)min(100, max(percent * 100, 0));
+  report.value = value;
   for (uint8_t i = 0; i < sizeof(report.filler); i++) {
     report.filler[i] = 0;
   }
 
   setReport(report.reportType, 0, 0, &report, sizeof(report));
 }
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
 
 void StreamdeckController::reset() {
   // SET_IDLE
@@ -157,11 +506,17 @@ void StreamdeckController::reset() {
 #endif // STREAMDECK_USBHOST_ENABLE_RESET
 }
 
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
 // Sends a blank outbound report to the device and empties the pending queue.
 void StreamdeckController::flushImageReports() {
-  for (uint8_t i = 0; i < pending_out_reports.size(); i++) {
-    pending_out_reports.pop();
-  }
+  __disable_irq();
+  reportTail = reportHead;
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+  // Dropped images will never be acknowledged.
+  memcpy(imagesCompleted, imagesQueued, sizeof(imagesCompleted));
+  latencyAwaitingKeys = 0;
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+  __enable_irq();
 
   // static streamdeck_out_report_type_t report;
   // report.reportType = HID_REPORT_TYPE_OUT;
@@ -179,108 +534,653 @@ void StreamdeckController::flushImageReports() {
   // sizeof(report));
 }
 
+// Image source for images already held in memory; the context is the image.
+static void memoryImageSource(uint8_t *dst, const uint32_t offset,
+                              const uint16_t length, void *context) {
+  memcpy(dst, (const uint8_t *)context + offset, length);
+}
+
 #if STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE
+// Image source for an all-black BMP of the size given by the device settings
+// passed as context.
+static void blankBmpSource(uint8_t *dst, const uint32_t offset,
+                           const uint16_t length, void *context) {
+  const device_settings_t *settings = (const device_settings_t *)context;
+  memset(dst, 0, length);
+  if (offset < BMP_HEADER_LENGTH) {
+    uint8_t header[BMP_HEADER_LENGTH];
+    fillBmpHeader(header, settings->keyWidth, settings->keyHeight);
+    memcpy(dst, header + offset, min(length, BMP_HEADER_LENGTH - offset));
+  }
+}
+
 // Sets a blank (black) image to the given key
 void StreamdeckController::setKeyBlank(const uint16_t keyIndex) {
-  setKeyImage(keyIndex, BLANK_KEY_IMAGE, sizeof(BLANK_KEY_IMAGE));
+  if (device()->imageFormat == IMAGE_FORMAT_BITMAP) {
+    setKeyImage(keyIndex,
+                bmpFileLength(device()->keyWidth, device()->keyHeight),
+                blankBmpSource, settings);
+  } else {
+    setKeyImage(keyIndex, BLANK_KEY_IMAGE, sizeof(BLANK_KEY_IMAGE));
+  }
 }
 
 void StreamdeckController::blankAllKeys() {
-  for (uint16_t i = 0; i < settings->keyCount; i++) {
+  for (uint16_t i = 0; i < device()->keyCount; i++) {
     setKeyBlank(i);
   }
 }
 #endif // STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+
+// Maps between our key numbering (left to right, top to bottom) and the
+// device's. The mapping is its own inverse.
+uint16_t StreamdeckController::deviceKeyIndex(const uint16_t keyIndex) {
+  if (!ANY_COLS_REVERSED || !device()->keyColsReversed)
+    return keyIndex;
+
+  const uint16_t col = keyIndex % device()->keyCols;
+  return keyIndex - col + (device()->keyCols - 1 - col);
+}
+
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+uint16_t
+StreamdeckController::imageReportHeaderLength(const image_target_t &target) {
+  if (ANY_SCREEN && target.type == IMAGE_TARGET_SCREEN)
+    return sizeof(report_header_16_screen_out_t);
+  return device()->imageReportHeaderLength;
+}
+
+void StreamdeckController::writeImageReportHeader(
+    uint8_t *report, const image_target_t &target, const uint16_t page,
+    const bool isFinal, const uint16_t length) {
+  if (ANY_SCREEN && target.type == IMAGE_TARGET_SCREEN) {
+    report_header_16_screen_out_t *header =
+        (report_header_16_screen_out_t *)report;
+    header->reportType = HID_REPORT_TYPE_OUT;
+    header->command = 0x0c;
+    header->x = target.x;
+    header->y = target.y;
+    header->width = target.width;
+    header->height = target.height;
+    header->isFinal = isFinal ? 1 : 0;
+    header->pageNumber = page;
+    header->payloadLength = length;
+    header->filler = 0;
+    return;
+  }
+
+  if (ANY_GEN1 && device()->protocol == REPORT_PROTOCOL_GEN1) {
+    report_header_16_out_t *header = (report_header_16_out_t *)report;
+    memset(header, 0, sizeof(report_header_16_out_t));
+    header->reportType = HID_REPORT_TYPE_OUT;
+    header->command = 1;
+    header->pageNumber = page + device()->imagePageBase;
+    header->isFinal = isFinal ? 1 : 0;
+    header->buttonId = target.deviceKey + 1;
+    return;
+  }
+
+  report_type_1024_8_out_t *header = (report_type_1024_8_out_t *)report;
+  header->reportType = HID_REPORT_TYPE_OUT;
+  if (target.type == IMAGE_TARGET_INFO_BAR) {
+    header->command = 0x0b;
+    header->buttonId = 0;
+  } else {
+    header->command = 7;
+    header->buttonId = target.deviceKey;
+  }
+  header->isFinal = isFinal ? 1 : 0;
+  header->payloadLength = length;
+  header->payloadNumber = page;
+}
 
 // Sets a jpeg image of the given length to the given key
 void StreamdeckController::setKeyImage(const uint16_t keyIndex,
                                        const uint8_t *image, uint16_t length) {
-  const uint16_t bytesPerPage = sizeof(report_type_1024_8_out_t) - 8;
-  uint16_t pageCount = 0;
-  uint16_t byteCount = 0;
+  setKeyImage(keyIndex, length, memoryImageSource, (void *)image);
+}
+
+void StreamdeckController::setKeyImage(const uint16_t keyIndex,
+                                       const uint32_t length,
+                                       image_source_t source, void *context) {
+  queueKeyImage(keyIndex, length, source, context, true);
+}
+
+image_queue_result_t
+StreamdeckController::trySetKeyImage(const uint16_t keyIndex,
+                                     const uint8_t *image,
+                                     const uint16_t length) {
+  return queueKeyImage(keyIndex, length, memoryImageSource, (void *)image,
+                       false);
+}
+
+image_queue_result_t
+StreamdeckController::trySetKeyImage(const uint16_t keyIndex,
+                                     const uint32_t length,
+                                     image_source_t source, void *context) {
+  return queueKeyImage(keyIndex, length, source, context, false);
+}
+
+image_queue_result_t
+StreamdeckController::queueKeyImage(const uint16_t keyIndex,
+                                    const uint32_t length,
+                                    image_source_t source, void *context,
+                                    const bool wait) {
+  // Nothing to send to during a replay, on a deck without a display or to a
+  // touch key.
+  if (!mydevice || !device()->imageReportLength ||
+      keyIndex >= device()->keyCount)
+    return IMAGE_NO_TARGET;
+
+  image_target_t target = {};
+  target.type = IMAGE_TARGET_KEY;
+  target.deviceKey = deviceKeyIndex(keyIndex);
+  if (!wait) {
+    const image_queue_result_t room = roomForImage(target, length);
+    if (room != IMAGE_QUEUED)
+      return room;
+  }
+
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+  latencyImageQueued(keyIndex);
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+
+  queueImage(target, length, source, context);
+  return IMAGE_QUEUED;
+}
+
+bool StreamdeckController::setScreenImage(const uint16_t x, const uint16_t y,
+                                          const uint16_t width,
+                                          const uint16_t height,
+                                          const uint8_t *image,
+                                          const uint32_t length) {
+  return queueScreenImage(x, y, width, height, length, memoryImageSource,
+                          (void *)image, true) == IMAGE_QUEUED;
+}
+
+bool StreamdeckController::setScreenImage(const uint16_t x, const uint16_t y,
+                                          const uint16_t width,
+                                          const uint16_t height,
+                                          const uint32_t length,
+                                          image_source_t source,
+                                          void *context) {
+  return queueScreenImage(x, y, width, height, length, source, context,
+                          true) == IMAGE_QUEUED;
+}
+
+image_queue_result_t StreamdeckController::trySetScreenImage(
+    const uint16_t x, const uint16_t y, const uint16_t width,
+    const uint16_t height, const uint8_t *image, const uint32_t length) {
+  return queueScreenImage(x, y, width, height, length, memoryImageSource,
+                          (void *)image, false);
+}
+
+image_queue_result_t StreamdeckController::trySetScreenImage(
+    const uint16_t x, const uint16_t y, const uint16_t width,
+    const uint16_t height, const uint32_t length, image_source_t source,
+    void *context) {
+  return queueScreenImage(x, y, width, height, length, source, context, false);
+}
+
+image_queue_result_t StreamdeckController::queueScreenImage(
+    const uint16_t x, const uint16_t y, const uint16_t width,
+    const uint16_t height, const uint32_t length, image_source_t source,
+    void *context, const bool wait) {
+  if (!mydevice || !device()->screenWidth || !width || !height ||
+      x + width > device()->screenWidth || y + height > device()->screenHeight)
+    return IMAGE_NO_TARGET;
+
+  image_target_t target = {};
+  if (device()->screenRegions) {
+    target.type = IMAGE_TARGET_SCREEN;
+  } else if (!x && !y && width == device()->screenWidth &&
+             height == device()->screenHeight) {
+    target.type = IMAGE_TARGET_INFO_BAR;
+  } else {
+    return IMAGE_NO_TARGET;
+  }
+  target.x = x;
+  target.y = y;
+  target.width = width;
+  target.height = height;
+  if (!wait) {
+    const image_queue_result_t room = roomForImage(target, length);
+    if (room != IMAGE_QUEUED)
+      return room;
+  }
+
+  queueImage(target, length, source, context);
+  return IMAGE_QUEUED;
+}
+
+// Payload bytes in each of the image's reports.
+uint32_t StreamdeckController::imagePageBytes(const image_target_t &target) {
+  return device()->imageReportLength - imageReportHeaderLength(target);
+}
+
+// Payload bytes in the first report. Some devices want the image split at a
+// fixed point rather than with the first report filled.
+uint32_t
+StreamdeckController::imageFirstPageBytes(const image_target_t &target) {
+  const uint32_t bytesPerPage = imagePageBytes(target);
+  if (device()->imageFirstPageLength)
+    return min(bytesPerPage, (uint32_t)device()->imageFirstPageLength);
+  return bytesPerPage;
+}
 
-  // Wait for the queue to be empty before starting a new transfer.
-  // while(!pending_out_reports.empty()) { delay(1); }
+// Whether every page of the image fits in the report ring right now, or ever.
+// Only the ISR frees slots, so the answer can only get better until the
+// caller queues.
+image_queue_result_t
+StreamdeckController::roomForImage(const image_target_t &target,
+                                   const uint32_t length) {
+  const uint32_t bytesPerPage = imagePageBytes(target);
+  const uint32_t firstPage = min(length, imageFirstPageBytes(target));
+  const uint32_t pages = (firstPage ? 1 : 0) +
+                         (length - firstPage + bytesPerPage - 1) / bytesPerPage;
+  if (pages > STREAMDECK_USBHOST_OUTPUT_BUFFERS)
+    return IMAGE_TOO_LARGE;
+  if (pages > STREAMDECK_USBHOST_OUTPUT_BUFFERS - getQueuedReports())
+    return IMAGE_QUEUE_FULL;
+  return IMAGE_QUEUED;
+}
+
+void StreamdeckController::queueImage(const image_target_t &target,
+                                      const uint32_t length,
+                                      image_source_t source, void *context) {
+  const uint16_t reportLength = device()->imageReportLength;
+  const uint16_t headerLength = imageReportHeaderLength(target);
+  const uint32_t bytesPerPage = imagePageBytes(target);
+  const uint32_t firstPageBytes = imageFirstPageBytes(target);
+  uint16_t pageCount = 0;
+  uint32_t byteCount = 0;
 
-  // Separate the image into chunks that fit into our 1024 bytes reports, set
-  // headers, and attempt to transfer them. If transfer buffers are full, adds
-  // their memory addresses to a queue which will be dealt with when previous
-  // transfers succeed.
+  // Separate the image into chunks that fit into the device's image reports,
+  // set headers, and queue them in the report ring. The source writes each
+  // chunk straight into its slot. Queued reports go out as soon as a transfer
+  // buffer is free; this only waits when the ring is full.
   //
   // Logic adapted from:
   // - https://den.dev/blog/reverse-engineering-stream-deck/
   while (byteCount < length) {
-    report_type_1024_8_out_t report;
+    while ((uint16_t)(reportHead - reportTail) >=
+           STREAMDECK_USBHOST_OUTPUT_BUFFERS) {
+      pumpQueuedReports();
+      yield();
+    }
+
+    uint8_t *report =
+        reportSlots[reportHead & (STREAMDECK_USBHOST_OUTPUT_BUFFERS - 1)];
 
     // Serial.printf("Page count: %u\n", pageCount);
-    report.reportType = HID_REPORT_TYPE_OUT;
-    report.command = 7;
-    report.buttonId = keyIndex;
-
-    uint16_t sliceLen = min(length - byteCount, bytesPerPage);
-    report.payloadLength = sliceLen;
-    report.isFinal = sliceLen != bytesPerPage ? 1 : 0;
-    report.payloadNumber = pageCount;
-
-    memcpy(report.payload, image + byteCount, sliceLen);
-    for (uint16_t i = bytesPerPage; i >= sliceLen; i--) {
-      report.payload[i] = 0;
-    }
+    const uint16_t sliceLen =
+        min(length - byteCount, pageCount ? bytesPerPage : firstPageBytes);
+    writeImageReportHeader(report, target, pageCount,
+                           byteCount + sliceLen == length, sliceLen);
 
-    out_report.write((uint8_t *)&report, sizeof(report));
+    source(report + headerLength, byteCount, sliceLen, context);
+    memset(report + headerLength + sliceLen, 0,
+           reportLength - headerLength - sliceLen);
 
     byteCount += sliceLen;
     pageCount++;
 
-    if (!driver_->sendPacket((const uint8_t *)out_report.peek_back(),
-                             sizeof(report))) {
+    reportHead++;
+    pumpQueuedReports();
+  }
+}
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+// Called before the first page of an image is queued. If the key has an
+// unanswered transition, this image is the one that answers it.
+void StreamdeckController::latencyImageQueued(const uint16_t keyIndex) {
+  if (keyIndex >= MAX_INPUT_KEYS)
+    return;
+
+  __disable_irq();
+  const uint8_t image = ++imagesQueued[keyIndex];
+  if (latencyStampedKeys & keyBit(keyIndex)) {
+    latencyStampedKeys &= ~keyBit(keyIndex);
+    latencyAwaitingKeys |= keyBit(keyIndex);
+    latencyAwaitingStamp[keyIndex] = latencyStamp[keyIndex];
+    latencyAwaitedImage[keyIndex] = image;
+  }
+  __enable_irq();
+}
+
+// Called from the out-data ISR with the report that was just acknowledged.
+void StreamdeckController::latencyImageSent(const uint8_t *data) {
+  const int16_t finalKey = finalImageReportKey(data);
+  if (finalKey < 0)
+    return;
+
+  const uint16_t key = finalKey;
+  const uint8_t image = ++imagesCompleted[key];
+  if ((latencyAwaitingKeys & keyBit(key)) &&
+      image == latencyAwaitedImage[key]) {
+    latencyAwaitingKeys &= ~keyBit(key);
+    recordLatency(key, micros() - latencyAwaitingStamp[key]);
+  }
+}
 
-      pending_out_reports.push((uint32_t)out_report.peek_back());
-    } else {
-      // Delay inserted to ensure the ISR has time to process.
-      delay(1);
+// Returns the key a report carries the final image page for, or -1 for any
+// other report.
+int16_t StreamdeckController::finalImageReportKey(const uint8_t *data) {
+  uint16_t deviceKey;
+  if (ANY_GEN1 && device()->protocol == REPORT_PROTOCOL_GEN1) {
+    const report_header_16_out_t *header = (const report_header_16_out_t *)data;
+    if (header->reportType != HID_REPORT_TYPE_OUT || header->command != 1 ||
+        !header->isFinal || !header->buttonId)
+      return -1;
+    deviceKey = header->buttonId - 1;
+  } else {
+    const report_type_1024_8_out_t *header =
+        (const report_type_1024_8_out_t *)data;
+    if (header->reportType != HID_REPORT_TYPE_OUT || header->command != 7 ||
+        !header->isFinal)
+      return -1;
+    deviceKey = header->buttonId;
+  }
+
+  if (deviceKey >= device()->keyCount)
+    return -1;
+  return deviceKeyIndex(deviceKey);
+}
+
+void StreamdeckController::recordLatency(const uint16_t keyIndex,
+                                         const uint32_t latencyMicros) {
+  latency_histogram_t &h = latency[keyIndex];
+  if (!h.count || latencyMicros < h.minMicros)
+    h.minMicros = latencyMicros;
+  if (latencyMicros > h.maxMicros)
+    h.maxMicros = latencyMicros;
+  h.totalMicros += latencyMicros;
+  h.count++;
+
+  // Bucket by the position of the highest set bit; everything below 256us
+  // lands in bucket 0.
+  const int8_t bucket = latencyMicros ? 31 - __builtin_clz(latencyMicros) - 7 : 0;
+  h.buckets[constrain(bucket, 0, LATENCY_HISTOGRAM_BUCKETS - 1)]++;
+}
+
+void StreamdeckController::resetLatency() {
+  __disable_irq();
+  memset(latency, 0, sizeof(latency));
+  __enable_irq();
+}
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+
+int8_t StreamdeckController::subscribe(const key_event_type_t type,
+                                      key_event_handler_t handler,
+                                      void *context, const keyMask_t keys) {
+  if (!handler)
+    return -1;
+
+  for (uint8_t i = 0; i < STREAMDECK_USBHOST_MAX_SUBSCRIBERS; i++) {
+    if (!subscribers[i].handler && !subscribers[i].controlHandler) {
+      subscribers[i].type = type;
+      subscribers[i].keys = keys;
+      subscribers[i].context = context;
+      subscribers[i].handler = handler;
+      return i;
     }
   }
+  return -1;
 }
 
-// This task needs to run frequently to trigger timed hooks
-void StreamdeckController::Task() {
-  bool changeOccurred = false;
-  uint32_t currentTime = millis();
-  for (uint16_t key = 0; key < settings->keyCount; key++) {
-    if (states[key].changed) {
-      changeOccurred = true;
-
-      // Serial.println("Processed key change.");
-      if (singleStateChangedFunction)
-        // Hook to simple state changed function.
-        singleStateChangedFunction(this, key, states[key].state, states[key].lastState);
+int8_t StreamdeckController::subscribe(control_event_handler_t handler,
+                                      void *context) {
+  if (!handler)
+    return -1;
+
+  for (uint8_t i = 0; i < STREAMDECK_USBHOST_MAX_SUBSCRIBERS; i++) {
+    if (!subscribers[i].handler && !subscribers[i].controlHandler) {
+      subscribers[i].context = context;
+      subscribers[i].controlHandler = handler;
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool StreamdeckController::unsubscribe(const int8_t handle) {
+  if (handle < 0 || handle >= (int8_t)STREAMDECK_USBHOST_MAX_SUBSCRIBERS ||
+      (!subscribers[handle].handler && !subscribers[handle].controlHandler))
+    return false;
+
+  subscribers[handle].handler = nullptr;
+  subscribers[handle].controlHandler = nullptr;
+  return true;
+}
+
+void StreamdeckController::replaceLegacySubscriber(
+    const key_event_type_t type, key_event_handler_t handler, void *f) {
+  unsubscribe(legacySubscribers[type]);
+  legacySubscribers[type] = f ? subscribe(type, handler, f) : -1;
+}
+
+void StreamdeckController::attachSinglePress(legacy_single_press_t f) {
+  replaceLegacySubscriber(KEY_EVENT_PRESS_RELEASE, legacySinglePress,
+                          (void *)f);
+}
+
+void StreamdeckController::attachAnyChange(legacy_any_change_t f) {
+  replaceLegacySubscriber(KEY_EVENT_ANY_CHANGE, legacyAnyChange, (void *)f);
+}
+
+void StreamdeckController::attachSingleKeyHeld(legacy_key_held_t f) {
+  replaceLegacySubscriber(KEY_EVENT_HELD, legacyKeyHeld, (void *)f);
+}
+
+// Hands the given keys to every subscriber of this event type whose key filter
+// matches. Only set bits are visited, so the cost follows the number of events
+// and subscribers rather than the number of keys on the device.
+void StreamdeckController::dispatchKeyEvents(const key_event_type_t type,
+                                             keyMask_t keys) {
+  key_event_t event;
+  event.type = type;
+  event.states = nullptr;
+
+  for (uint8_t i = 0; i < STREAMDECK_USBHOST_MAX_SUBSCRIBERS; i++) {
+    const subscriber_t &sub = subscribers[i];
+    if (!sub.handler || sub.type != type)
+      continue;
+
+    if (type == KEY_EVENT_ANY_CHANGE) {
+      if (!event.states)
+        event.states = buildStateView();
+      sub.handler(this, &event, sub.context);
+      continue;
     }
 
-    // Track keys held longer than 1 second.
-    if (states[key].state == 1 && currentTime > states[key].changedTime + 1000) {
-      if (!states[key].holdResolved) {
-        states[key].holdResolved = true;
-        // Serial.println("Processed key held.");
-        if (singleKeyHeldFunction) {
-          singleKeyHeldFunction(this, key);
-        }
+    keyMask_t pending = keys & sub.keys;
+    while (pending) {
+      const uint16_t key = __builtin_ctz(pending);
+      pending &= pending - 1;
+
+      event.keyIndex = key;
+      event.newValue = (front().state >> key) & 1U;
+      event.oldValue = (front().lastState >> key) & 1U;
+      sub.handler(this, &event, sub.context);
+    }
+  }
+}
+
+keyState_t *StreamdeckController::buildStateView() {
+  const keySnapshot_t &snapshot = front();
+  const uint16_t keyCount =
+      settings ? device()->keyCount + device()->touchKeyCount : 0;
+  for (uint16_t i = 0; i < keyCount; i++) {
+    stateView[i].state = (snapshot.state >> i) & 1U;
+    stateView[i].lastState = (snapshot.lastState >> i) & 1U;
+    stateView[i].changed = (changedKeys >> i) & 1U;
+    stateView[i].changedTime = snapshot.changedTime[i];
+    stateView[i].holdResolved = (heldKeys >> i) & 1U;
+  }
+  return stateView;
+}
+
+const keyState_t *StreamdeckController::getKeyStates() {
+  return buildStateView();
+}
+
+// Reports the finished batch to any-change subscribers, then retires it.
+void StreamdeckController::finishKeyBatch() {
+  // Hook to user functions wanting all states at once.
+  dispatchKeyEvents(KEY_EVENT_ANY_CHANGE, batchKeys);
+
+  // Kill the changed flags and track which pressed keys may become held.
+  changedKeys &= ~batchKeys;
+  unresolvedHeldKeys =
+      (unresolvedHeldKeys & ~batchKeys) | (batchKeys & front().state);
+  batchKeys = 0;
+}
+
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+void StreamdeckController::dispatchControlEvent(const control_event_t *event) {
+  for (uint8_t i = 0; i < STREAMDECK_USBHOST_MAX_SUBSCRIBERS; i++) {
+    const subscriber_t &sub = subscribers[i];
+    if (sub.controlHandler)
+      sub.controlHandler(this, event, sub.context);
+  }
+}
+
+// Hands out the dial input gathered since the last call, at most one turn
+// and one press/release pair per dial, then any queued touch gestures.
+void StreamdeckController::dispatchControlEvents() {
+  control_event_t event;
+
+  for (uint8_t i = 0; i < device()->dialCount; i++) {
+    __disable_irq();
+    const dialInput_t dial = dialInput[i];
+    dialInput[i].delta = 0;
+    dialInput[i].pressTransitions = 0;
+    __enable_irq();
+
+    memset(&event, 0, sizeof(event));
+    event.control = CONTROL_TYPE_DIAL;
+    event.dialIndex = i;
+
+    if (dial.delta) {
+      event.type = CONTROL_EVENT_DIAL_TURN;
+      event.delta = dial.delta;
+      event.timestamp = dial.turnTime;
+      dispatchControlEvent(&event);
+      event.delta = 0;
+    }
+
+    if (dial.pressTransitions) {
+      event.type = CONTROL_EVENT_DIAL_PRESS;
+      event.timestamp = dial.pressTime;
+      if (dial.pressTransitions > 1) {
+        event.pressed = !dial.pressed;
+        dispatchControlEvent(&event);
       }
+      event.pressed = dial.pressed;
+      dispatchControlEvent(&event);
     }
   }
 
-  if (changeOccurred && anyStateChangedFunction) {
-    changeOccurred = false;
-    // Hook to user function.
-    anyStateChangedFunction(this, states);
-    // Serial.println("Processed any key changed.");
+  while (touchTail != touchHead) {
+    event = touchEvents[touchTail & (STREAMDECK_USBHOST_TOUCH_EVENTS - 1)];
+    touchTail++;
+    dispatchControlEvent(&event);
   }
+}
+
+uint16_t StreamdeckController::pendingControlEvents() {
+  if (!settings)
+    return 0;
+
+  uint16_t pending = (uint8_t)(touchHead - touchTail);
+  for (uint8_t i = 0; i < device()->dialCount; i++) {
+    if (dialInput[i].delta || dialInput[i].pressTransitions)
+      pending++;
+  }
+  return pending;
+}
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+
+// This task needs to run frequently to trigger timed hooks
+uint32_t StreamdeckController::Task(const uint32_t budgetMicros) {
+  const uint32_t startTime = micros();
+  uint32_t currentTime = millis();
+
+  // Once the previous batch is finished, publish the snapshot the input path
+  // has been building (if it has anything new) and start a batch with its
+  // changed keys. The input path moves on to the other buffer from here.
+  if (!batchKeys) {
+    const uint8_t back = frontIndex ^ 1;
+    if (snapshots[back].sequence > snapshots[frontIndex].sequence) {
+      frontIndex = back;
+      batchKeys = snapshots[back].changed;
+      pendingPressKeys = batchKeys;
+      changedKeys = batchKeys;
+      heldKeys &= ~batchKeys;
+    }
+  }
+
+  // Hook to simple state changed functions, one key at a time so a budget can
+  // cut in between.
+  while (pendingPressKeys) {
+    const keyMask_t bit = pendingPressKeys & (~pendingPressKeys + 1);
+    dispatchKeyEvents(KEY_EVENT_PRESS_RELEASE, bit);
+    pendingPressKeys &= ~bit;
+
+    if (budgetMicros && micros() - startTime >= budgetMicros)
+      break;
+  }
+
+  if (batchKeys && !pendingPressKeys)
+    finishKeyBatch();
+
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  if (MAX_DIAL_COUNT && settings && device()->dialCount &&
+      (!budgetMicros || micros() - startTime < budgetMicros))
+    dispatchControlEvents();
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+
+  // Track keys held longer than 1 second.
+  keyMask_t held = 0;
+  keyMask_t pending = unresolvedHeldKeys;
+  while (pending) {
+    const uint16_t key = __builtin_ctz(pending);
+    pending &= pending - 1;
+
+    if (currentTime > front().changedTime[key] + 1000)
+      held |= keyBit(key);
+  }
+  if (held) {
+    heldKeys |= held;
+    unresolvedHeldKeys &= ~held;
+    dispatchKeyEvents(KEY_EVENT_HELD, held);
+  }
+
+  // Read the deck's identification strings, one transfer per call.
+  if (mydevice && deviceInfoReady != (1U << DEVICE_INFO_COUNT) - 1)
+    requestDeviceInfo();
+
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  // Keep the report ring moving in case the ISR found it empty.
+  if (mydevice)
+    pumpQueuedReports();
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
 
-  // iterate again to kill the changed flag.
-  for (uint16_t key = 0; key < settings->keyCount; key++)
-      states[key].changed = false;
+#if STREAMDECK_USBHOST_ENABLE_RECORDER
+  if (recorder_)
+    recorder_->flush();
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
 
-  delay(1);
+  const keySnapshot_t &next = snapshots[frontIndex ^ 1];
+  const bool unpublished = next.sequence > snapshots[frontIndex].sequence;
+  uint32_t work = __builtin_popcount(pendingPressKeys) + (batchKeys ? 1 : 0) +
+                  (unpublished ? __builtin_popcount(next.changed) : 0);
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  work += pendingControlEvents() + getQueuedReports();
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+  return work;
 }
 
-} // namespace Streamdeck
\ No newline at end of file
+} // namespace Streamdeck
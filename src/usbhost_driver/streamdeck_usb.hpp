@@ -29,11 +29,32 @@ Credit to:
 #include "../../streamdeck_config.hpp"
 #include <Arduino.h>
 #include <USBHost_t36.h>
-#include <circular_buffer.h>
-#include <queue>
 
 namespace Streamdeck {
 
+#if STREAMDECK_USBHOST_ENABLE_RECORDER
+class InputRecorder;
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
+
+#if STREAMDECK_USBHOST_PEDAL_ONLY &&                                           \
+    (STREAMDECK_IMAGE_HELPER_ENABLE || STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE || \
+     STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING)
+#error "Pedal-only builds cannot enable images or latency tracking"
+#endif
+
+static_assert((STREAMDECK_USBHOST_OUTPUT_BUFFERS &
+               (STREAMDECK_USBHOST_OUTPUT_BUFFERS - 1)) == 0,
+              "STREAMDECK_USBHOST_OUTPUT_BUFFERS must be a power of 2");
+// The smallest ring that holds a whole Neo info bar image (248x58 pixels,
+// up to 8 kB of JPEG) for trySetScreenImage.
+const uint8_t NEO_MIN_OUTPUT_BUFFERS = 8;
+static_assert(!STREAMDECK_USBHOST_ENABLE_NEO ||
+                  STREAMDECK_USBHOST_OUTPUT_BUFFERS >= NEO_MIN_OUTPUT_BUFFERS,
+              "The Neo needs STREAMDECK_USBHOST_OUTPUT_BUFFERS of at least 8");
+static_assert((STREAMDECK_USBHOST_TOUCH_EVENTS &
+               (STREAMDECK_USBHOST_TOUCH_EVENTS - 1)) == 0,
+              "STREAMDECK_USBHOST_TOUCH_EVENTS must be a power of 2");
+
 #if STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE
 // 72 x 72 black JPEG
 const uint8_t BLANK_KEY_IMAGE[] = {
@@ -100,6 +121,8 @@ const uint8_t BLANK_KEY_IMAGE[] = {
     0x02, 0x8a, 0x28, 0xa0, 0x0f, 0xff, 0xd9};
 #endif // STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE
 
+// Per-key view of the key state, as handed out by getKeyStates(). The
+// controller itself keeps these as bitmaps; see keySnapshot_t.
 struct keyState_t {
   uint8_t state;
   uint8_t lastState;
@@ -108,46 +131,252 @@ struct keyState_t {
   bool holdResolved;
 };
 
+// One bit per key; bit 0 is key 0. 32 bits covers the largest supported deck
+// (XL).
+typedef uint32_t keyMask_t;
+const keyMask_t KEY_MASK_ALL = 0xffffffffUL;
+const uint16_t KEY_MASK_MAX_KEYS = sizeof(keyMask_t) * 8;
+static_assert(MAX_INPUT_KEYS <= KEY_MASK_MAX_KEYS,
+              "Every key of every enabled model needs a bit in keyMask_t");
+
+inline keyMask_t keyBit(const uint16_t keyIndex) {
+  return (keyMask_t)1U << keyIndex;
+}
+
+enum key_event_type_t {
+  KEY_EVENT_PRESS_RELEASE = 0,
+  KEY_EVENT_HELD,
+  KEY_EVENT_ANY_CHANGE
+};
+
+struct key_event_t {
+  key_event_type_t type;
+  uint16_t keyIndex;       // Unused for KEY_EVENT_ANY_CHANGE
+  uint8_t newValue;        // Unused for KEY_EVENT_HELD
+  uint8_t oldValue;        // Unused for KEY_EVENT_HELD
+  const keyState_t *states; // Only set for KEY_EVENT_ANY_CHANGE
+};
+
+// Stream Deck+ dial and touchscreen events.
+enum control_event_type_t {
+  CONTROL_EVENT_DIAL_TURN = 0,
+  CONTROL_EVENT_DIAL_PRESS,
+  CONTROL_EVENT_TOUCH_TAP,
+  CONTROL_EVENT_TOUCH_PRESS, // Long press
+  CONTROL_EVENT_TOUCH_SWIPE
+};
+
+struct control_event_t {
+  control_event_type_t type;
+  control_type_t control;
+  uint8_t dialIndex;  // Dial events only
+  int16_t delta;      // Turn ticks since the last event, clockwise positive
+  bool pressed;       // CONTROL_EVENT_DIAL_PRESS only
+  uint16_t x;         // Touch events only; start of a swipe
+  uint16_t y;
+  uint16_t xOut;      // CONTROL_EVENT_TOUCH_SWIPE only; end of the swipe
+  uint16_t yOut;
+  uint32_t timestamp; // micros() when the (latest) report arrived
+};
+
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+// Latencies are binned by powers of two: bucket 0 holds everything below
+// 256us, bucket i (i > 0) holds [128us << i, 256us << i), and the last bucket
+// also holds everything above.
+const uint8_t LATENCY_HISTOGRAM_BUCKETS = 16;
+
+struct latency_histogram_t {
+  uint32_t count;
+  uint32_t minMicros;
+  uint32_t maxMicros;
+  uint64_t totalMicros;
+  uint16_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+};
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+
+// Identification strings read from the deck with GET_FEATURE_REPORT.
+enum device_info_t {
+  DEVICE_INFO_FIRMWARE_VERSION = 0,
+  DEVICE_INFO_SERIAL_NUMBER,
+  DEVICE_INFO_COUNT
+};
+
+// Longest string a feature report can carry, with the terminator.
+const uint8_t DEVICE_INFO_MAX_LENGTH = 32U;
+
+class StreamdeckController;
+
+// Supplies `length` bytes of an image, starting `offset` bytes into it, to
+// `dst`. Lets images be generated straight into outbound report pages.
+typedef void (*image_source_t)(uint8_t *dst, const uint32_t offset,
+                               const uint16_t length, void *context);
+
+// What a non-blocking image upload did.
+enum image_queue_result_t {
+  IMAGE_QUEUED = 0, // Every page is in the report ring
+  IMAGE_QUEUE_FULL, // Not enough free slots right now; try again later
+  IMAGE_TOO_LARGE,  // More pages than the whole ring; only set*Image sends it
+  IMAGE_NO_TARGET   // No deck attached, or the key or region takes no images
+};
+
+typedef void (*key_event_handler_t)(StreamdeckController *sdc,
+                                    const key_event_t *event, void *context);
+typedef void (*control_event_handler_t)(StreamdeckController *sdc,
+                                        const control_event_t *event,
+                                        void *context);
+
 class StreamdeckController : public USBHIDInput {
 public:
   StreamdeckController(USBHost &host) { init(); }
   StreamdeckController(USBHost *host) { init(); }
 
 public:
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
   void setBrightness(float percent);
   void flushImageReports();
+  // Queues the image's pages in the report ring. Waits for the deck to take
+  // pages for as long as the ring is full; see trySetKeyImage().
   void setKeyImage(const uint16_t keyIndex, const uint8_t *image,
                    const uint16_t length);
+  // Same, with the image bytes pulled from a source one page at a time. The
+  // image must be in the device's native format (getSettings()->imageFormat).
+  void setKeyImage(const uint16_t keyIndex, const uint32_t length,
+                   image_source_t source, void *context);
+  // Sets a jpeg image to a region of the screen. Only the Stream Deck+
+  // touchscreen takes partial regions; the Neo info bar takes whole images
+  // only (x = y = 0 and the full screen size). Goes through the same report
+  // ring as key images. Returns false if the region can't be sent to.
+  bool setScreenImage(const uint16_t x, const uint16_t y, const uint16_t width,
+                      const uint16_t height, const uint8_t *image,
+                      const uint32_t length);
+  bool setScreenImage(const uint16_t x, const uint16_t y, const uint16_t width,
+                      const uint16_t height, const uint32_t length,
+                      image_source_t source, void *context);
+  // Non-blocking versions of the above. The image is queued whole
+  // (IMAGE_QUEUED), or nothing is queued: IMAGE_QUEUE_FULL when the report
+  // ring lacks room for every page of it right now (try again after Task()),
+  // IMAGE_TOO_LARGE when it has more pages than
+  // STREAMDECK_USBHOST_OUTPUT_BUFFERS and so can only go out blocking.
+  image_queue_result_t trySetKeyImage(const uint16_t keyIndex,
+                                      const uint8_t *image,
+                                      const uint16_t length);
+  image_queue_result_t trySetKeyImage(const uint16_t keyIndex,
+                                      const uint32_t length,
+                                      image_source_t source, void *context);
+  image_queue_result_t trySetScreenImage(const uint16_t x, const uint16_t y,
+                                         const uint16_t width,
+                                         const uint16_t height,
+                                         const uint8_t *image,
+                                         const uint32_t length);
+  image_queue_result_t trySetScreenImage(const uint16_t x, const uint16_t y,
+                                         const uint16_t width,
+                                         const uint16_t height,
+                                         const uint32_t length,
+                                         image_source_t source, void *context);
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
 #if STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE
   void setKeyBlank(const uint16_t keyIndex);
   void blankAllKeys();
-  device_settings_t *getSettings() { return settings; }
 #endif // STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE
+  device_settings_t *getSettings() { return settings; }
+  // The most recently published key states, consistent as of the last
+  // Task() call. Valid for getNumKeys() entries. Built from the bitmaps below
+  // on each call.
+  const keyState_t *getKeyStates();
+  // The same state, straight from the published bitmaps.
+  keyMask_t getPressedKeys() { return front().state; }
+  keyMask_t getChangedKeys() { return changedKeys; }
+  bool isKeyPressed(const uint16_t keyIndex) {
+    return front().state & keyBit(keyIndex);
+  }
+  bool isKeyHeld(const uint16_t keyIndex) {
+    return front().state & heldKeys & keyBit(keyIndex);
+  }
+  uint32_t getKeyChangedTime(const uint16_t keyIndex) {
+    return keyIndex < MAX_INPUT_KEYS ? front().changedTime[keyIndex] : 0;
+  }
   uint16_t getNumKeys() {
     if (settings) {
       return settings->keyCount;
     } else
       return 0;
   };
+  // Imageless touch keys (Neo). Their states follow the regular keys, so
+  // touch key n is key index getNumKeys() + n.
+  uint16_t getNumTouchKeys() { return settings ? settings->touchKeyCount : 0; }
   void reset();
 
-  // Call these to attach your own function hooks
+  // Firmware version and serial number of the connected deck. Task() asks the
+  // deck for them with non-blocking GET_FEATURE_REPORT transfers, again each
+  // second until answered; these return nullptr until the answer has arrived,
+  // after which the cached string is returned without touching the bus.
+  const char *getFirmwareVersion() {
+    return getDeviceInfo(DEVICE_INFO_FIRMWARE_VERSION);
+  }
+  const char *getSerialNumber() {
+    return getDeviceInfo(DEVICE_INFO_SERIAL_NUMBER);
+  }
+  const char *getDeviceInfo(const device_info_t info);
+
+  // Subscribe a handler to one event type. The context pointer is handed back
+  // to the handler untouched, and only keys set in the keys mask trigger it
+  // (ignored for KEY_EVENT_ANY_CHANGE). Returns a handle for unsubscribe(), or
+  // -1 if all STREAMDECK_USBHOST_MAX_SUBSCRIBERS slots are taken.
+  int8_t subscribe(const key_event_type_t type, key_event_handler_t handler,
+                   void *context = nullptr, const keyMask_t keys = KEY_MASK_ALL);
+  // Subscribe a handler to dial and touchscreen events. Shares the subscriber
+  // table (and unsubscribe()) with key event handlers.
+  int8_t subscribe(control_event_handler_t handler, void *context = nullptr);
+  bool unsubscribe(const int8_t handle);
+
+  // Call these to attach your own function hooks. Each replaces the previous
+  // hook of the same kind and occupies one subscriber slot.
   void attachSinglePress(void (*f)(StreamdeckController *sdc,
                                    const uint16_t keyIndex,
                                    const uint8_t newValue,
-                                   const uint8_t oldValue)) {
-    singleStateChangedFunction = f;
-  }
+                                   const uint8_t oldValue));
   void attachAnyChange(void (*f)(StreamdeckController *sdc,
-                                 keyState_t *states)) {
-    anyStateChangedFunction = f;
-  }
+                                 keyState_t *states));
   void attachSingleKeyHeld(void (*f)(StreamdeckController *sdc,
-                                     const uint16_t keyIndex)) {
-    singleKeyHeldFunction = f;
+                                     const uint16_t keyIndex));
+
+  // Runs event dispatch, hold detection and outbound report pumping. With a
+  // non-zero budget, stops once that many microseconds have passed and leaves
+  // the rest for the next call. Returns the number of work items still
+  // pending (events to dispatch plus image reports waiting to be sent), so 0
+  // means the controller is idle. Never sleeps. The budget doesn't cover
+  // setKeyImage()/setScreenImage(), which wait whenever the report ring is
+  // full; use the trySet versions to keep the loop bounded.
+  uint32_t Task(const uint32_t budgetMicros = 0);
+
+#if STREAMDECK_USBHOST_ENABLE_RECORDER
+  // Copies every raw input report into the recorder. Task() writes the
+  // captured reports out; pass nullptr to stop.
+  void attachRecorder(InputRecorder *recorder) { recorder_ = recorder; }
+
+  // Lets a replayer drive this controller with no deck attached: picks the
+  // settings for the recorded product, after which injected reports go
+  // through the same parsing path as live ones. Image uploads are dropped
+  // while replaying.
+  bool beginReplay(const uint16_t productId);
+  void injectInputReport(const uint8_t *report, const uint16_t length);
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
+
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+  // Press-to-photon latency for a key: from a key transition arriving to the
+  // final page of the next image set on that key being acknowledged.
+  const latency_histogram_t *getKeyLatency(const uint16_t keyIndex) {
+    return keyIndex < MAX_INPUT_KEYS ? &latency[keyIndex] : nullptr;
   }
+  void resetLatency();
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
 
-  void Task();
+  // Number of outbound image reports queued but not yet handed to the driver.
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  uint16_t getQueuedReports() { return reportHead - reportTail; }
+#else
+  uint16_t getQueuedReports() { return 0; }
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
 
 protected:
   enum report_type_t {
@@ -174,6 +403,44 @@ protected:
     uint8_t payload[1016];
   };
 
+  // Generation 1 image report header; the payload follows directly.
+  struct __attribute__((packed)) report_header_16_out_t {
+    uint8_t reportType;
+    uint8_t command;
+    uint8_t pageNumber;
+    uint8_t filler1;
+    uint8_t isFinal;
+    uint8_t buttonId; // 1-based
+    uint8_t filler2[10];
+  };
+
+  // Touchscreen region image report header; the payload follows directly.
+  struct __attribute__((packed)) report_header_16_screen_out_t {
+    uint8_t reportType;
+    uint8_t command;
+    uint16_t x;      // little endian
+    uint16_t y;      // little endian
+    uint16_t width;  // little endian
+    uint16_t height; // little endian
+    uint8_t isFinal;
+    uint16_t pageNumber;    // little endian
+    uint16_t payloadLength; // little endian
+    uint8_t filler;
+  };
+
+  // Generation 1 feature report (brightness and friends).
+  struct __attribute__((packed)) report_type_17_6_feature_t {
+    uint8_t reportType;
+    uint8_t command[4];
+    uint8_t value;
+    uint8_t filler[11];
+  };
+
+  // Outbound report slots and transfer buffers fit the largest image report
+  // of any enabled device.
+  static const uint16_t REPORT_SLOT_SIZE =
+      MAX_IMAGE_REPORT_LENGTH ? MAX_IMAGE_REPORT_LENGTH : 1;
+
   struct __attribute__((packed)) report_type_32_3_out_t {
     uint8_t reportType;
     uint8_t request;
@@ -198,42 +465,194 @@ protected:
 
 private:
   void init();
+  bool selectDevice(const uint16_t productId);
+  bool processInputReport(const uint8_t *data, const uint16_t length);
+  uint16_t deviceKeyIndex(const uint16_t keyIndex);
+
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  // Where an image goes: a key, a region of the touchscreen or the info bar.
+  enum image_target_type_t {
+    IMAGE_TARGET_KEY = 0,
+    IMAGE_TARGET_SCREEN,
+    IMAGE_TARGET_INFO_BAR
+  };
+  struct image_target_t {
+    image_target_type_t type;
+    uint16_t deviceKey;
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+  };
+  image_queue_result_t queueKeyImage(const uint16_t keyIndex,
+                                     const uint32_t length,
+                                     image_source_t source, void *context,
+                                     const bool wait);
+  image_queue_result_t queueScreenImage(const uint16_t x, const uint16_t y,
+                                        const uint16_t width,
+                                        const uint16_t height,
+                                        const uint32_t length,
+                                        image_source_t source, void *context,
+                                        const bool wait);
+  uint32_t imagePageBytes(const image_target_t &target);
+  uint32_t imageFirstPageBytes(const image_target_t &target);
+  image_queue_result_t roomForImage(const image_target_t &target,
+                                    const uint32_t length);
+  void queueImage(const image_target_t &target, const uint32_t length,
+                  image_source_t source, void *context);
+  uint16_t imageReportHeaderLength(const image_target_t &target);
+  void writeImageReportHeader(uint8_t *report, const image_target_t &target,
+                              const uint16_t page, const bool isFinal,
+                              const uint16_t length);
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
   bool setReport(const uint8_t reportType, const uint8_t reportId,
                  const uint8_t interface, void *buffer,
                  const uint16_t bufferLength = 8U);
+  bool getReport(const uint8_t reportType, const uint8_t reportId,
+                 const uint8_t interface, void *buffer,
+                 const uint16_t bufferLength);
+  void requestDeviceInfo();
 
-  void (*singleStateChangedFunction)(StreamdeckController *sdc,
-                                     const uint16_t keyIndex,
-                                     const uint8_t newValue,
-                                     const uint8_t oldValue);
-  void (*anyStateChangedFunction)(StreamdeckController *sdc,
-                                  keyState_t *states);
-  void (*singleKeyHeldFunction)(StreamdeckController *sdc,
-                                const uint16_t keyIndex);
+  struct subscriber_t {
+    key_event_type_t type;
+    keyMask_t keys;
+    key_event_handler_t handler; // Both handlers nullptr marks a free slot
+    control_event_handler_t controlHandler;
+    void *context;
+  };
+
+  void dispatchKeyEvents(const key_event_type_t type, keyMask_t keys);
+  void finishKeyBatch();
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  void dispatchControlEvent(const control_event_t *event);
+  void processControlReport(const uint8_t *data, const uint16_t length);
+  void dispatchControlEvents();
+  uint16_t pendingControlEvents();
+  void sendQueuedReports();
+  void pumpQueuedReports();
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+  void replaceLegacySubscriber(const key_event_type_t type,
+                               key_event_handler_t handler, void *f);
+
+  subscriber_t subscribers[STREAMDECK_USBHOST_MAX_SUBSCRIBERS] = {};
+  int8_t legacySubscribers[KEY_EVENT_ANY_CHANGE + 1] = {-1, -1, -1};
 
   device_settings_t *settings = nullptr;
 
-  // Key states to track (for different Stream Deck devices)
-  keyState_t *states;
+  // The connected deck's settings. In single-model builds this is a
+  // compile-time constant, so every field read through it folds away.
+  const device_settings_t *device() const {
+    return SINGLE_DEVICE ? &DeviceList[0] : settings;
+  }
+
+  // Key states to track (for different Stream Deck devices), double buffered.
+  // The input path only ever writes the back snapshot and stamps it with a
+  // newer sequence number; Task() publishes it with a single store to
+  // frontIndex. Consumers only ever see the front snapshot, which the input
+  // path never touches, so they cannot observe a half-applied report.
+  // Per-key flags are kept as one bitmap each so reports are diffed and
+  // scanned a word at a time; only the timestamps need a slot per key.
+  struct keySnapshot_t {
+    keyMask_t state;     // Pressed keys
+    keyMask_t lastState; // Each key's state before its latest change
+    keyMask_t changed;   // Keys changed since the previous publish
+    uint32_t changedTime[MAX_INPUT_KEYS]; // millis() of each key's last change
+    uint32_t sequence;
+  };
+  keySnapshot_t snapshots[2] = {};
+  volatile uint8_t frontIndex = 0;
+  uint32_t inputSequence = 0; // Only touched by the input path
+
+  keySnapshot_t &front() { return snapshots[frontIndex]; }
+
+  // Per-key copy of the front snapshot for getKeyStates() and any-change
+  // handlers.
+  keyState_t stateView[MAX_INPUT_KEYS];
+  keyState_t *buildStateView();
+
+  // Keys pressed but not yet reported as held. Task() only visits keys set in
+  // this mask.
+  keyMask_t unresolvedHeldKeys = 0;
+
+  // Task()'s own view on top of the front snapshot: keys of the published
+  // batch not yet dispatched, and pressed keys already reported as held. They
+  // live here rather than in the snapshot so that Task() never writes the
+  // front; a publish clears a key's held bit when the key changed.
+  keyMask_t changedKeys = 0;
+  keyMask_t heldKeys = 0;
+
+  // The batch of changed keys Task() is working through, and the part of it
+  // still waiting for its press/release dispatch when a budget ran out.
+  keyMask_t batchKeys = 0;
+  keyMask_t pendingPressKeys = 0;
+
+#if !STREAMDECK_USBHOST_PEDAL_ONLY
+  // Dial input, accumulated by the input path until Task() hands it out.
+  // Turns are summed; press transitions are counted so a quick press and
+  // release between two Task() calls still produces both events.
+  struct dialInput_t {
+    int16_t delta;
+    uint8_t pressTransitions;
+    bool pressed;
+    uint32_t turnTime;
+    uint32_t pressTime;
+  };
+  dialInput_t dialInput[MAX_DIALS] = {};
+
+  // Touchscreen gestures, queued by the input path and drained by Task().
+  control_event_t touchEvents[STREAMDECK_USBHOST_TOUCH_EVENTS];
+  volatile uint8_t touchHead = 0;
+  volatile uint8_t touchTail = 0;
 
   // Uncached transfer buffers large enough to hold our outbound report packets
   // (image slices with header data).
-  uint8_t drv_tx1_[sizeof(report_type_1024_8_out_t)];
-  uint8_t drv_tx2_[sizeof(report_type_1024_8_out_t)];
-
-  // A circular buffer for stowing uncached outbound (image) reports until the
-  // isr has time to send them out. This works alongside a separate queue to
-  // ensure reports get sent out eventually regardless of transfer
-  // buffer state. uint8_t out_report[sizeof(streamdeck_out_report_type_t) *
-  // STREAMDECK_IMAGE_OUTPUT_BUFFERS];
-  Circular_Buffer<uint8_t, STREAMDECK_USBHOST_OUTPUT_BUFFERS,
-                  sizeof(report_type_1024_8_out_t)>
-      out_report;
-
-  // Separate queue for marking only pending reports to be sent.
-  std::queue<uint32_t> pending_out_reports;
-
-  bool processingInData = false;
+  uint8_t drv_tx1_[REPORT_SLOT_SIZE];
+  uint8_t drv_tx2_[REPORT_SLOT_SIZE];
+
+  // A ring of uncached outbound (image) reports waiting for a free transfer
+  // buffer. setKeyImage fills slots at the head; the out-data ISR and Task()
+  // send them from the tail. A slot is reusable as soon as sendPacket has
+  // copied it into a transfer buffer.
+  uint8_t reportSlots[STREAMDECK_USBHOST_OUTPUT_BUFFERS][REPORT_SLOT_SIZE];
+  volatile uint16_t reportHead = 0;
+  volatile uint16_t reportTail = 0;
+  // Set while reports are being handed to the driver. sendPacket briefly
+  // re-enables interrupts, so this keeps the ISR from sending the same slot.
+  volatile bool sendingReports = false;
+#endif // !STREAMDECK_USBHOST_PEDAL_ONLY
+
+#if STREAMDECK_USBHOST_ENABLE_RECORDER
+  InputRecorder *recorder_ = nullptr;
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
+
+#if STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+  void latencyImageQueued(const uint16_t keyIndex);
+  void latencyImageSent(const uint8_t *report);
+  int16_t finalImageReportKey(const uint8_t *report);
+  void recordLatency(const uint16_t keyIndex, const uint32_t latencyMicros);
+
+  // Input side: keys with an unanswered transition and when it arrived.
+  volatile keyMask_t latencyStampedKeys = 0;
+  uint32_t latencyStamp[MAX_INPUT_KEYS];
+  // Output side: images queued and completed per key, and which queued image
+  // (if any) answers a stamped transition.
+  keyMask_t latencyAwaitingKeys = 0;
+  uint32_t latencyAwaitingStamp[MAX_INPUT_KEYS];
+  uint8_t latencyAwaitedImage[MAX_INPUT_KEYS];
+  uint8_t imagesQueued[MAX_INPUT_KEYS];
+  uint8_t imagesCompleted[MAX_INPUT_KEYS];
+
+  latency_histogram_t latency[MAX_INPUT_KEYS];
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+
+  // Device info cache. One GET_FEATURE_REPORT is in flight at a time, into
+  // featureBuffer; hid_process_control copies the string out and sets the
+  // info's bit in deviceInfoReady.
+  char deviceInfo[DEVICE_INFO_COUNT][DEVICE_INFO_MAX_LENGTH];
+  volatile uint8_t deviceInfoReady = 0;
+  volatile int8_t deviceInfoPending = -1;
+  uint32_t deviceInfoRequestTime = 0;
+  uint8_t featureBuffer[DEVICE_INFO_MAX_LENGTH] __attribute__((aligned(32)));
 
   uint8_t collections_claimed = 0;
   USBHIDParser *driver_;
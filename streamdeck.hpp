@@ -26,8 +26,15 @@ Credit to:
 */
 #pragma once
 #include "src/usbhost_driver/streamdeck_usb.hpp"
+#include "src/usbhost_driver/streamdeck_recorder.hpp"
 #if STREAMDECK_IMAGE_HELPER_ENABLE
 #include "src/image_helper/streamdeck_graphics.hpp"
+#include "src/image_helper/streamdeck_screen.hpp"
+#include "src/image_helper/streamdeck_jpeg_transform.hpp"
+#include "src/image_helper/streamdeck_animation.hpp"
+#include "src/image_helper/streamdeck_panel.hpp"
+#include "src/image_helper/streamdeck_video.hpp"
+#include "src/image_helper/streamdeck_directory.hpp"
 #endif // STREAMDECK_IMAGE_HELPER_ENABLE
 
 namespace Streamdeck {
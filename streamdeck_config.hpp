@@ -29,14 +29,76 @@ Credit to:
 /* All options in this file can be overridden using build directives in
  * PlatformIO */
 
-// This number of report buffers should be enough for 2-3 images to fully
-// buffer. The default setting aims for around 3-5 kBytes max per JPG being sent
-// to the streamdeck (remove exif data). If your images are significantly
-// larger, you may want to increase this value. Each buffer takes up 1024 Bytes.
-// Buffer count must be an exponent of 2. These are persistent in a circular
-// buffer and the memory is not freed.
+// Build for the Stream Deck Pedal alone. The Pedal has no display, so this
+// drops image uploads, the outbound report ring and transfer buffers, the
+// blank key image and the Image Helper, and no other model is enabled.
+// Default: disabled.
+#ifndef STREAMDECK_USBHOST_PEDAL_ONLY
+#define STREAMDECK_USBHOST_PEDAL_ONLY 0U
+#endif // STREAMDECK_USBHOST_PEDAL_ONLY
+
+// Support the original (v1) Stream Deck. It takes 8191 Byte image reports, so
+// enabling it grows every outbound report slot and both transfer buffers from
+// 1024 to 8191 Bytes. Default: disabled.
+#ifndef STREAMDECK_USBHOST_ENABLE_ORIGINAL_V1
+#define STREAMDECK_USBHOST_ENABLE_ORIGINAL_V1 0U
+#endif // STREAMDECK_USBHOST_ENABLE_ORIGINAL_V1
+
+// The other models to support. Buffers are sized for the enabled models only,
+// code paths no enabled model uses are dropped, and with exactly one model
+// enabled every device setting becomes a compile-time constant. Default: all
+// enabled (only the Pedal for Pedal-only builds).
+#if STREAMDECK_USBHOST_PEDAL_ONLY
+#define STREAMDECK_USBHOST_MODEL_DEFAULT 0U
+#else
+#define STREAMDECK_USBHOST_MODEL_DEFAULT 1U
+#endif
+
+#ifndef STREAMDECK_USBHOST_ENABLE_ORIGINAL_V2
+#define STREAMDECK_USBHOST_ENABLE_ORIGINAL_V2 STREAMDECK_USBHOST_MODEL_DEFAULT
+#endif // STREAMDECK_USBHOST_ENABLE_ORIGINAL_V2
+
+#ifndef STREAMDECK_USBHOST_ENABLE_MK2
+#define STREAMDECK_USBHOST_ENABLE_MK2 STREAMDECK_USBHOST_MODEL_DEFAULT
+#endif // STREAMDECK_USBHOST_ENABLE_MK2
+
+// Covers both the Mini and the Mini MK2.
+#ifndef STREAMDECK_USBHOST_ENABLE_MINI
+#define STREAMDECK_USBHOST_ENABLE_MINI STREAMDECK_USBHOST_MODEL_DEFAULT
+#endif // STREAMDECK_USBHOST_ENABLE_MINI
+
+#ifndef STREAMDECK_USBHOST_ENABLE_XL
+#define STREAMDECK_USBHOST_ENABLE_XL STREAMDECK_USBHOST_MODEL_DEFAULT
+#endif // STREAMDECK_USBHOST_ENABLE_XL
+
+#ifndef STREAMDECK_USBHOST_ENABLE_PLUS
+#define STREAMDECK_USBHOST_ENABLE_PLUS STREAMDECK_USBHOST_MODEL_DEFAULT
+#endif // STREAMDECK_USBHOST_ENABLE_PLUS
+
+#ifndef STREAMDECK_USBHOST_ENABLE_NEO
+#define STREAMDECK_USBHOST_ENABLE_NEO STREAMDECK_USBHOST_MODEL_DEFAULT
+#endif // STREAMDECK_USBHOST_ENABLE_NEO
+
+#ifndef STREAMDECK_USBHOST_ENABLE_PEDAL
+#define STREAMDECK_USBHOST_ENABLE_PEDAL 1U
+#endif // STREAMDECK_USBHOST_ENABLE_PEDAL
+
+// Number of outbound report slots queued ahead of the USB transfer buffers.
+// Each slot takes up the largest image report of the enabled models (1024
+// Bytes, or 8191 with the original v1) and holds one page of a key image
+// (~1 kByte of JPG). setKeyImage only waits when every slot is still queued,
+// so more slots let larger images (or more keys at once) be queued without
+// waiting. Buffer count must be an exponent of 2. These are persistent in a
+// circular buffer and the memory is not freed. Non-blocking uploads
+// (trySetKeyImage, trySetScreenImage) need room for a whole image, so with the
+// Neo enabled at least 8 are required to fit its info bar.
+// Default: 8 with the Neo, else 4.
 #ifndef STREAMDECK_USBHOST_OUTPUT_BUFFERS
+#if STREAMDECK_USBHOST_ENABLE_NEO
+#define STREAMDECK_USBHOST_OUTPUT_BUFFERS 8U
+#else
 #define STREAMDECK_USBHOST_OUTPUT_BUFFERS 4U
+#endif
 #endif // STREAMDECK_USBHOST_OUTPUT_BUFFERS
 
 // Resetting the streamdeck causes USBHost_t36 Pipes to break. If you still want
@@ -45,27 +107,141 @@ Credit to:
 #define STREAMDECK_USBHOST_ENABLE_RESET 0U
 #endif // STREAMDECK_USBHOST_ENABLE_RESET
 
+// Number of event subscriber slots available on each StreamdeckController.
+// Each slot holds one handler, its context pointer and its key filter. The
+// legacy attach* functions each occupy one slot when used.
+#ifndef STREAMDECK_USBHOST_MAX_SUBSCRIBERS
+#define STREAMDECK_USBHOST_MAX_SUBSCRIBERS 8U
+#endif // STREAMDECK_USBHOST_MAX_SUBSCRIBERS
+
+// Number of Stream Deck+ touchscreen gestures held between Task() calls. Dial
+// turns are coalesced and need no queue. Must be an exponent of 2.
+#ifndef STREAMDECK_USBHOST_TOUCH_EVENTS
+#define STREAMDECK_USBHOST_TOUCH_EVENTS 4U
+#endif // STREAMDECK_USBHOST_TOUCH_EVENTS
+
+// Enables InputRecorder and InputReplayer, which log raw input reports with
+// their arrival times and feed them back through the same parsing path.
+// Meant for benchmarking against recorded sessions. Default: disabled.
+#ifndef STREAMDECK_USBHOST_ENABLE_RECORDER
+#define STREAMDECK_USBHOST_ENABLE_RECORDER 0U
+#endif // STREAMDECK_USBHOST_ENABLE_RECORDER
+
+// Number of input reports the recorder can hold between Task() calls before
+// it starts dropping them. Each takes up 520 Bytes.
+#ifndef STREAMDECK_USBHOST_RECORDER_BUFFERS
+#define STREAMDECK_USBHOST_RECORDER_BUFFERS 4U
+#endif // STREAMDECK_USBHOST_RECORDER_BUFFERS
+
+// Measures press-to-photon latency: from a key transition arriving to the
+// final page of the next image sent to that key being acknowledged by the
+// deck. Results go into per-key histograms (about 50 Bytes per key).
+// Default: disabled.
+#ifndef STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+#define STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING 0U
+#endif // STREAMDECK_USBHOST_ENABLE_LATENCY_TRACKING
+
 // Choose whether or not to include the default blank keyimage at compile time.
-// Defaults to enabled. Disabling this also removes the setKeyBlank and
-// blankAllKeys functions.
+// Defaults to enabled (disabled for Pedal-only builds). Disabling this also
+// removes the setKeyBlank and blankAllKeys functions.
 #ifndef STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE
+#if STREAMDECK_USBHOST_PEDAL_ONLY
+#define STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE 0U
+#else
 #define STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE 1U
+#endif
 #endif // STREAMDECK_USBHOST_ENABLE_BLANK_IMAGE
 
 // Optionally disable the Image Helper library. Do this if your images are all
 // pre-prepared or if you handle images being fed to the Streamdeck all on your
-// own. Default: enabled.
+// own. Default: enabled (disabled for Pedal-only builds).
 #ifndef STREAMDECK_IMAGE_HELPER_ENABLE
+#if STREAMDECK_USBHOST_PEDAL_ONLY
+#define STREAMDECK_IMAGE_HELPER_ENABLE 0U
+#else
 #define STREAMDECK_IMAGE_HELPER_ENABLE 1U
+#endif
 #endif // STREAMDECK_IMAGE_HELPER_ENABLE
 
 #ifndef STREAMDECK_IMAGE_HELPER_USE_SD
 #define STREAMDECK_IMAGE_HELPER_USE_SD 1U
 #endif // STREAMDECK_IMAGE_HELPER_USE_SD
 
+// Most JPEGs an ImageDirectory (and so importJpegRandom) indexes in one
+// directory. Each takes STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH + 12 Bytes.
+#ifndef STREAMDECK_IMAGE_HELPER_INDEX_ENTRIES
+#define STREAMDECK_IMAGE_HELPER_INDEX_ENTRIES 128U
+#endif // STREAMDECK_IMAGE_HELPER_INDEX_ENTRIES
+
+// Longest file name an ImageDirectory indexes, including the terminator.
+// Files with longer names are left out.
+#ifndef STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH
+#define STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH 32U
+#endif // STREAMDECK_IMAGE_HELPER_INDEX_NAME_LENGTH
+
+// Let importJpeg decode a JPEG's embedded EXIF thumbnail instead of the main
+// image whenever the thumbnail is at least as large as the key. Camera photos
+// then import orders of magnitude faster. Default: enabled.
+#ifndef STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS
+#define STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS 1U
+#endif // STREAMDECK_IMAGE_HELPER_EXIF_THUMBNAILS
+
 // This value estimates how large the outgoing JPG to the streamdeck might be.
-// This space is calloc'd and occupied only temporarily before it's loaded into
-// the outbound report and transfer buffers.
+// This space is calloc'd (or reserved once with
+// STREAMDECK_IMAGE_HELPER_STATIC_MEMORY) and occupied only temporarily before
+// it's loaded into the outbound report and transfer buffers.
 #ifndef STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE
 #define STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE 10000
-#endif // STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE
\ No newline at end of file
+#endif // STREAMDECK_IMAGE_HELPER_OUT_BUFFER_SIZE
+
+// Number of changed regions a ScreenCanvas tracks before it starts merging
+// them. Touching regions are always merged.
+#ifndef STREAMDECK_IMAGE_HELPER_SCREEN_DIRTY_RECTS
+#define STREAMDECK_IMAGE_HELPER_SCREEN_DIRTY_RECTS 8U
+#endif // STREAMDECK_IMAGE_HELPER_SCREEN_DIRTY_RECTS
+
+// Number of keys an AnimationScheduler can play GIFs on at once.
+#ifndef STREAMDECK_IMAGE_HELPER_ANIMATION_SLOTS
+#define STREAMDECK_IMAGE_HELPER_ANIMATION_SLOTS 8U
+#endif // STREAMDECK_IMAGE_HELPER_ANIMATION_SLOTS
+
+// Bytes a VideoPlayer reserves for reading MJPEG frames. Must hold the
+// largest compressed frame plus one SD read (8 kB); larger frames are
+// dropped.
+#ifndef STREAMDECK_IMAGE_HELPER_VIDEO_BUFFER_SIZE
+#define STREAMDECK_IMAGE_HELPER_VIDEO_BUFFER_SIZE 49152U
+#endif // STREAMDECK_IMAGE_HELPER_VIDEO_BUFFER_SIZE
+
+// Reserve every Image Helper buffer at compile time instead of on the heap:
+// Image and ScreenCanvas framebuffers come from fixed pools sized for the
+// largest enabled key and screen, transform() works in one fixed scratch
+// framebuffer, and encoding uses one shared output buffer. Gives
+// deterministic timing and no heap fragmentation. Default: disabled.
+#ifndef STREAMDECK_IMAGE_HELPER_STATIC_MEMORY
+#define STREAMDECK_IMAGE_HELPER_STATIC_MEMORY 0U
+#endif // STREAMDECK_IMAGE_HELPER_STATIC_MEMORY
+
+// Static memory only: number of key framebuffers in the pool, i.e. how many
+// Images without a caller-provided framebuffer may exist at once.
+#ifndef STREAMDECK_IMAGE_HELPER_STATIC_IMAGES
+#define STREAMDECK_IMAGE_HELPER_STATIC_IMAGES 2U
+#endif // STREAMDECK_IMAGE_HELPER_STATIC_IMAGES
+
+// Static memory only: number of screen framebuffers in the pool.
+#ifndef STREAMDECK_IMAGE_HELPER_STATIC_SCREENS
+#define STREAMDECK_IMAGE_HELPER_STATIC_SCREENS 1U
+#endif // STREAMDECK_IMAGE_HELPER_STATIC_SCREENS
+
+// Static memory only: size of the scratch buffer in Bytes, when more than the
+// one key framebuffer it always holds. PanelImporter needs one row of key
+// framebuffers plus one decoded JPEG band (source width x 16 pixels) here.
+#ifndef STREAMDECK_IMAGE_HELPER_STATIC_SCRATCH_BYTES
+#define STREAMDECK_IMAGE_HELPER_STATIC_SCRATCH_BYTES 0U
+#endif // STREAMDECK_IMAGE_HELPER_STATIC_SCRATCH_BYTES
+
+// Static memory only: fail the build if the Image Helper's static buffers plus
+// one StreamdeckController take up more than this many Bytes. 0 disables the
+// check.
+#ifndef STREAMDECK_STATIC_MEMORY_LIMIT
+#define STREAMDECK_STATIC_MEMORY_LIMIT 0U
+#endif // STREAMDECK_STATIC_MEMORY_LIMIT